@@ -1,6 +1,10 @@
 
 #include "Actor.hpp"
 
+#include <algorithm>
+
+uint64_t Actor::counter = 0;
+
 glm::vec3 Actor::getPosition() const {
     return glm::vec3(getTransform()[3]);
 }
@@ -17,15 +21,22 @@ glm::vec3 Actor::getUp() const {
     return glm::vec3(getTransform()[1]);
 }
 
+uint64_t Actor::stamp() {
+    return ++counter;
+}
+
 Actor const * AttachableActor::getParent() const {
     return parent;
 }
 
 void AttachableActor::setParent(Actor const * parent) {
     this->parent = parent;
+    invalidate();
 }
 
 glm::mat4 AttachableActor::getTransform() const {
+    if (world_version == getVersion())
+        return world;
     if (parent)
         return parent->getTransform() * transform;
     return transform;
@@ -37,10 +48,12 @@ glm::mat4 AttachableActor::getRelativeTransform() const {
 
 void AttachableActor::setRelativeTransform(glm::mat4 const & transform) {
     this->transform = transform;
+    invalidate();
 }
 
 void AttachableActor::setRelativeTransform(glm::vec3 const & position, glm::vec3 const & forward, glm::vec3 const & up) {
     this->transform = glm::inverse(glm::lookAt(position, position + forward, up));
+    invalidate();
 }
 
 void AttachableActor::setRelativePosition(glm::vec3 const & position) {
@@ -61,4 +74,18 @@ void AttachableActor::setRelativeVelocity(glm::vec3 const & velocity) {
     this->velocity = velocity;
 }
 
-AttachableActor::AttachableActor() : parent(nullptr) {}
+uint64_t AttachableActor::getVersion() const {
+    
+    // Any modification along the chain yields a stamp greater than all previous ones
+    if (parent)
+        return std::max(version, parent->getVersion());
+    return version;
+}
+
+AttachableActor::AttachableActor() : parent(nullptr), version(stamp()), world_version(0) {}
+
+void AttachableActor::invalidate() {
+    
+    // Children notice it through their own version, other caches are kept
+    version = stamp();
+}
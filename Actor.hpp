@@ -21,19 +21,31 @@ public:
     virtual glm::vec3 getVelocity() const = 0;
     // TODO angular velocity
     
+    // Note: increases whenever transform may have changed, including through ancestors
+    virtual uint64_t getVersion() const = 0;
+    
 protected:
     
     Actor() = default;
     virtual ~Actor() = default;
     
+    // Note: stamps are drawn from a shared counter only to be unique and increasing, each actor is validated against its own ancestors
+    static uint64_t stamp();
+    
+private:
+    
+    static uint64_t counter;
+    
 };
 
 class AttachableActor : public Actor {
+    friend class Hierarchy;
 public:
     
     Actor const * getParent() const;
     void setParent(Actor const * parent);
     
+    // Note: served from cache if updated by a hierarchy since last modification of this actor or its ancestors
     glm::mat4 getTransform() const;
     // TODO setTransform
     glm::mat4 getRelativeTransform() const;
@@ -46,6 +58,9 @@ public:
     glm::vec3 getRelativeVelocity() const;
     void setRelativeVelocity(glm::vec3 const & velocity);
     
+    // Note: most recent stamp among this actor and its ancestors
+    uint64_t getVersion() const;
+    
 protected:
     
     AttachableActor();
@@ -57,6 +72,15 @@ private:
     glm::mat4 transform;
     glm::vec3 velocity;
     
+    // Local stamp, renewed when relative transform or parent changes
+    uint64_t version;
+    
+    // Cached world transform, valid while version of this actor is unchanged
+    glm::mat4 world;
+    uint64_t world_version;
+    
+    void invalidate();
+    
 };
 
 #endif
@@ -17,6 +17,8 @@ Body::Body(Physics * physics, btCollisionShape * shape, glm::vec3 const & positi
     physics->world->addRigidBody(body);
     physics->bodies.push_front(this);
     iterator = physics->bodies.begin();
+    version = 0;
+    synchronize();
 }
 
 Body::~Body() {
@@ -32,14 +34,25 @@ Body::~Body() {
 }
 
 glm::mat4 Body::getTransform() const {
-    btTransform transform;
-    body->getMotionState()->getWorldTransform(transform);
-    glm::mat4 matrix;
-    transform.getOpenGLMatrix(glm::value_ptr(matrix));
-    return matrix;
+    return transform;
 }
 
 glm::vec3 Body::getVelocity() const {
     btVector3 velocity = body->getLinearVelocity();
     return {velocity.getX(), velocity.getY(), velocity.getZ()};
 }
+
+uint64_t Body::getVersion() const {
+    return version;
+}
+
+void Body::synchronize() {
+    btTransform transform;
+    body->getMotionState()->getWorldTransform(transform);
+    glm::mat4 matrix;
+    transform.getOpenGLMatrix(glm::value_ptr(matrix));
+    if (version == 0 || matrix != this->transform) {
+        this->transform = matrix;
+        version = stamp();
+    }
+}
@@ -18,8 +18,10 @@ public:
     Body(Body const &) = delete;
     Body & operator=(Body const &) = delete;
     
+    // Note: transform is read from simulation once per step
     glm::mat4 getTransform() const;
     glm::vec3 getVelocity() const;
+    uint64_t getVersion() const;
     
     // TODO can be attached to another actor (i.e. authoritative fixed object)
     // TODO also allow "soft" attach, probably using spring constraints?
@@ -40,6 +42,12 @@ private:
     
     btCollisionShape * shape;
     btRigidBody * body;
+    
+    // Cached transform, stamped only when body actually moved
+    glm::mat4 transform;
+    uint64_t version;
+    
+    void synchronize();
 
 };
 
@@ -24,6 +24,10 @@ void Buffer::setData(GLuint size, void const * pointer, GLenum usage) {
     glBufferData(target, size, pointer, usage);
 }
 
+void Buffer::setStorage(GLuint size, void const * pointer, GLbitfield flags) {
+    glBufferStorage(target, size, pointer, flags);
+}
+
 void Buffer::setSubData(GLuint offset, GLuint size, void const * pointer) {
     glBufferSubData(target, offset, size, pointer);
 }
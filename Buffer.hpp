@@ -18,6 +18,8 @@ public:
     void bind(GLenum target);
     
     void setData(GLuint size, void const * pointer, GLenum usage);
+    // Note: immutable storage, can only be called once
+    void setStorage(GLuint size, void const * pointer, GLbitfield flags);
     void setSubData(GLuint offset, GLuint size, void const * pointer);
     void getSubData(GLuint offset, GLuint size, void * pointer);
     
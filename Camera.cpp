@@ -15,6 +15,10 @@ glm::mat4 Camera::getView() const {
     return glm::inverse(getTransform());
 }
 
+Frustum Camera::getFrustum() const {
+    return Frustum(projection * getView());
+}
+
 Framebuffer * Camera::getFramebuffer() const {
     return framebuffer;
 }
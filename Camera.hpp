@@ -4,6 +4,7 @@
 
 #include "Actor.hpp"
 #include "Framebuffer.hpp"
+#include "Frustum.hpp"
 
 class Camera : public AttachableActor {
 public:
@@ -15,6 +16,8 @@ public:
     
     glm::mat4 getView() const;
     
+    Frustum getFrustum() const;
+    
     // TODO viewport (x, y, width, height)
     // TODO fov, clipping planes...?
     
@@ -36,7 +36,9 @@
 #include <iostream>
 #include <list>
 #include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #undef PI
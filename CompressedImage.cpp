@@ -0,0 +1,307 @@
+
+#include "CompressedImage.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// Bump version whenever the layout changes, so that stale caches are discarded
+uint32_t const BINARY_MAGIC = 0x43424c47; // "GLBC"
+uint32_t const BINARY_VERSION = 1;
+
+struct BinaryHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t levels;
+    uint32_t size;
+};
+
+GLuint getBlockSize(GLenum format) {
+    return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+}
+
+uint16_t packColor(glm::ivec3 const & color) {
+    return (uint16_t)(((color.x >> 3) << 11) | ((color.y >> 2) << 5) | (color.z >> 3));
+}
+
+glm::ivec3 unpackColor(uint16_t color) {
+    int r = (color >> 11) & 31;
+    int g = (color >> 5) & 63;
+    int b = color & 31;
+    return glm::ivec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+// Encode color part of a block, always in four-color mode, so that it is also valid in BC3
+void encodeColor(uint8_t const (*pixels)[4], uint8_t * block) {
+    
+    // Use bounding box of colors, slightly inset to reduce error
+    glm::ivec3 low(255), high(0);
+    for (int i = 0; i < 16; ++i) {
+        glm::ivec3 color(pixels[i][0], pixels[i][1], pixels[i][2]);
+        low = glm::min(low, color);
+        high = glm::max(high, color);
+    }
+    glm::ivec3 inset = (high - low) / 16;
+    uint16_t c0 = packColor(high - inset);
+    uint16_t c1 = packColor(low + inset);
+    
+    // Four-color mode requires c0 > c1, and equal endpoints use only the first one
+    if (c0 < c1)
+        std::swap(c0, c1);
+    glm::ivec3 palette[4];
+    palette[0] = unpackColor(c0);
+    palette[1] = unpackColor(c1);
+    palette[2] = (palette[0] * 2 + palette[1]) / 3;
+    palette[3] = (palette[0] + palette[1] * 2) / 3;
+    uint32_t indices = 0;
+    if (c0 != c1)
+        for (int i = 0; i < 16; ++i) {
+            glm::ivec3 color(pixels[i][0], pixels[i][1], pixels[i][2]);
+            int best = 0;
+            int best_error = 3 * 256 * 256;
+            for (int j = 0; j < 4; ++j) {
+                glm::ivec3 d = color - palette[j];
+                int error = d.x * d.x + d.y * d.y + d.z * d.z;
+                if (error < best_error) {
+                    best = j;
+                    best_error = error;
+                }
+            }
+            indices |= best << (i * 2);
+        }
+    memcpy(block, &c0, 2);
+    memcpy(block + 2, &c1, 2);
+    memcpy(block + 4, &indices, 4);
+}
+
+// Encode alpha part of a BC3 block, in eight-alpha mode
+void encodeAlpha(uint8_t const (*pixels)[4], uint8_t * block) {
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        a0 = std::max(a0, (int)pixels[i][3]);
+        a1 = std::min(a1, (int)pixels[i][3]);
+    }
+    int palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    for (int j = 1; j < 7; ++j)
+        palette[j + 1] = ((7 - j) * a0 + j * a1) / 7;
+    uint64_t indices = 0;
+    if (a0 != a1)
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            int best_error = 256;
+            for (int j = 0; j < 8; ++j) {
+                int error = std::abs(pixels[i][3] - palette[j]);
+                if (error < best_error) {
+                    best = j;
+                    best_error = error;
+                }
+            }
+            indices |= (uint64_t)best << (i * 3);
+        }
+    block[0] = a0;
+    block[1] = a1;
+    for (int i = 0; i < 6; ++i)
+        block[2 + i] = (indices >> (i * 8)) & 0xff;
+}
+
+}
+
+CompressedImage::CompressedImage() : width(0), height(0), format(GL_COMPRESSED_RGB_S3TC_DXT1_EXT), offsets(1, 0) {}
+
+GLuint CompressedImage::getWidth() const {
+    return width;
+}
+
+GLuint CompressedImage::getHeight() const {
+    return height;
+}
+
+GLenum CompressedImage::getFormat() const {
+    return format;
+}
+
+GLuint CompressedImage::getLevelCount() const {
+    return offsets.size() - 1;
+}
+
+GLuint CompressedImage::getLevelWidth(GLuint level) const {
+    return std::max(width >> level, 1u);
+}
+
+GLuint CompressedImage::getLevelHeight(GLuint level) const {
+    return std::max(height >> level, 1u);
+}
+
+GLuint CompressedImage::getLevelSize(GLuint level) const {
+    return offsets[level + 1] - offsets[level];
+}
+
+void const * CompressedImage::getLevelPointer(GLuint level) const {
+    return blocks.data() + offsets[level];
+}
+
+void CompressedImage::compress(Image const & image) {
+    width = image.getWidth();
+    height = image.getHeight();
+    offsets.assign(1, 0);
+    blocks.clear();
+    if (width == 0 || height == 0)
+        return;
+    
+    // Select format, BC1 being enough if every pixel is opaque
+    GLuint count = width * height;
+    uint8_t const * source = (uint8_t const *)image.getPointer();
+    format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    for (GLuint i = 0; i < count; ++i)
+        if (source[i * 4 + 3] != 0xff) {
+            format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            break;
+        }
+    GLuint size = getBlockSize(format);
+    
+    // Encode each level, then downsample it for the next one
+    std::vector<uint8_t> level(source, source + count * 4);
+    GLuint w = width, h = height;
+    while (true) {
+        GLuint columns = (w + 3) / 4;
+        GLuint rows = (h + 3) / 4;
+        GLuint offset = blocks.size();
+        blocks.resize(offset + columns * rows * size);
+        for (GLuint by = 0; by < rows; ++by)
+            for (GLuint bx = 0; bx < columns; ++bx) {
+                
+                // Gather pixels, repeating edges for partial blocks
+                uint8_t pixels[16][4];
+                for (GLuint y = 0; y < 4; ++y)
+                    for (GLuint x = 0; x < 4; ++x) {
+                        GLuint px = std::min(bx * 4 + x, w - 1);
+                        GLuint py = std::min(by * 4 + y, h - 1);
+                        memcpy(pixels[y * 4 + x], &level[(px + py * w) * 4], 4);
+                    }
+                uint8_t * block = &blocks[offset + (bx + by * columns) * size];
+                if (size == 16) {
+                    encodeAlpha(pixels, block);
+                    block += 8;
+                }
+                encodeColor(pixels, block);
+            }
+        offsets.push_back(blocks.size());
+        if (w == 1 && h == 1)
+            break;
+        
+        // Average 2x2 pixels, clamping on odd sizes
+        GLuint nw = std::max(w / 2, 1u);
+        GLuint nh = std::max(h / 2, 1u);
+        std::vector<uint8_t> next(nw * nh * 4);
+        for (GLuint y = 0; y < nh; ++y)
+            for (GLuint x = 0; x < nw; ++x) {
+                GLuint x0 = std::min(x * 2, w - 1), x1 = std::min(x * 2 + 1, w - 1);
+                GLuint y0 = std::min(y * 2, h - 1), y1 = std::min(y * 2 + 1, h - 1);
+                for (GLuint c = 0; c < 4; ++c)
+                    next[(x + y * nw) * 4 + c] = (level[(x0 + y0 * w) * 4 + c] + level[(x1 + y0 * w) * 4 + c] + level[(x0 + y1 * w) * 4 + c] + level[(x1 + y1 * w) * 4 + c] + 2) / 4;
+            }
+        level.swap(next);
+        w = nw;
+        h = nh;
+    }
+}
+
+void CompressedImage::promote() {
+    if (format != GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+        return;
+    
+    // Prepend a constant opaque alpha block to each color block
+    // Note: color blocks are already in four-color mode, which BC3 always uses
+    std::vector<uint8_t> promoted(blocks.size() * 2);
+    uint8_t const alpha[8] = {0xff, 0xff, 0, 0, 0, 0, 0, 0};
+    for (size_t i = 0; i < blocks.size() / 8; ++i) {
+        memcpy(&promoted[i * 16], alpha, 8);
+        memcpy(&promoted[i * 16 + 8], &blocks[i * 8], 8);
+    }
+    for (GLuint & offset : offsets)
+        offset *= 2;
+    blocks.swap(promoted);
+    format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+bool CompressedImage::loadBinary(std::string const & path) {
+    FILE * file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    
+    // Check header
+    BinaryHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != BINARY_MAGIC || header.version != BINARY_VERSION) {
+        fclose(file);
+        return false;
+    }
+    
+    // Check that sizes match file length, as file may be truncated or corrupted
+    long position = ftell(file);
+    fseek(file, 0, SEEK_END);
+    uint64_t length = ftell(file);
+    fseek(file, position, SEEK_SET);
+    GLuint levels = 0;
+    if (header.width > 0 && header.height > 0)
+        while (std::max(header.width, header.height) >> levels)
+            ++levels;
+    bool known = header.format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || header.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    if (!known || header.levels != levels || length != sizeof(header) + (header.levels + 1) * (uint64_t)sizeof(GLuint) + header.size) {
+        fclose(file);
+        return false;
+    }
+    
+    // Read level offsets and blocks
+    offsets.resize(header.levels + 1);
+    blocks.resize(header.size);
+    bool valid =
+        fread(offsets.data(), sizeof(GLuint), offsets.size(), file) == offsets.size() &&
+        (header.size == 0 || fread(blocks.data(), header.size, 1, file) == 1) &&
+        offsets[0] == 0;
+    fclose(file);
+    
+    // Each level must hold exactly its blocks
+    for (GLuint level = 0; valid && level < header.levels; ++level) {
+        uint64_t columns = (std::max(header.width >> level, 1u) + 3) / 4;
+        uint64_t rows = (std::max(header.height >> level, 1u) + 3) / 4;
+        valid = offsets[level + 1] >= offsets[level] && offsets[level + 1] - offsets[level] == columns * rows * getBlockSize(header.format);
+    }
+    valid = valid && offsets.back() == header.size;
+    if (!valid) {
+        offsets.assign(1, 0);
+        blocks.clear();
+        return false;
+    }
+    width = header.width;
+    height = header.height;
+    format = header.format;
+    return true;
+}
+
+bool CompressedImage::saveBinary(std::string const & path) const {
+    FILE * file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+    BinaryHeader header;
+    header.magic = BINARY_MAGIC;
+    header.version = BINARY_VERSION;
+    header.width = width;
+    header.height = height;
+    header.format = format;
+    header.levels = getLevelCount();
+    header.size = blocks.size();
+    bool valid =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(offsets.data(), sizeof(GLuint), offsets.size(), file) == offsets.size() &&
+        (blocks.empty() || fwrite(blocks.data(), blocks.size(), 1, file) == 1);
+    fclose(file);
+    if (!valid)
+        remove(path.c_str());
+    return valid;
+}
@@ -0,0 +1,44 @@
+
+#ifndef GLOW_COMPRESSEDIMAGE_HPP
+#define GLOW_COMPRESSEDIMAGE_HPP
+
+#include "Common.hpp"
+#include "Image.hpp"
+
+// Block-compressed image with its full mipmap chain
+// Note: opaque images use BC1 (4 bits per pixel), others use BC3 (8 bits per pixel)
+class CompressedImage {
+public:
+    
+    CompressedImage();
+    
+    GLuint getWidth() const;
+    GLuint getHeight() const;
+    GLenum getFormat() const;
+    
+    GLuint getLevelCount() const;
+    GLuint getLevelWidth(GLuint level) const;
+    GLuint getLevelHeight(GLuint level) const;
+    GLuint getLevelSize(GLuint level) const;
+    void const * getLevelPointer(GLuint level) const;
+    
+    // Build mipmaps using a box filter, then encode each level
+    void compress(Image const & image);
+    
+    // Convert BC1 blocks to BC3 with opaque alpha, so that it can share an array with translucent images
+    void promote();
+    
+    bool loadBinary(std::string const & path);
+    bool saveBinary(std::string const & path) const;
+    
+private:
+    
+    GLuint width;
+    GLuint height;
+    GLenum format;
+    std::vector<GLuint> offsets; // Note: one more than levels
+    std::vector<uint8_t> blocks;
+    
+};
+
+#endif
@@ -13,6 +13,10 @@ glm::vec3 Controller::getVelocity() const {
     return velocity;
 }
 
+uint64_t Controller::getVersion() const {
+    return version;
+}
+
 uint32_t Controller::getAxisCount() const {
     return 0;
 }
@@ -44,6 +48,6 @@ boolx Controller::getSecondaryButton() const {
     return getButton(1);
 }
 
-Controller::Controller() : index(-1), current(0) {
+Controller::Controller() : index(-1), version(0), current(0) {
     // TODO init states?
 }
@@ -18,6 +18,7 @@ public:
     
     glm::mat4 getTransform() const;
     glm::vec3 getVelocity() const;
+    uint64_t getVersion() const;
     
     uint32_t getAxisCount() const;
     float getAxis(uint32_t id) const;
@@ -37,6 +38,7 @@ private:
     int index;
     glm::mat4 transform;
     glm::vec3 velocity;
+    uint64_t version;
     int current;
 #ifndef GLOW_NO_OPENVR
     vr::VRControllerState_t state[2];
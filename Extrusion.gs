@@ -1,18 +1,42 @@
 #version 330 core
 
-layout (triangles) in;
-layout (triangle_strip, max_vertices = 14) out;
+#ifdef STEREO
+
+#extension GL_ARB_gpu_shader5 : require
+#extension GL_ARB_viewport_array : require
+
+// Emit volume once per eye, using side-by-side viewports
+layout (triangles_adjacency, invocations = 2) in;
+
+uniform mat4 projection[2];
+uniform mat4 view[2];
+
+#else
+
+layout (triangles_adjacency) in;
 
 uniform mat4 projection;
 uniform mat4 view;
 
+#endif
+
+layout (triangle_strip, max_vertices = 18) out;
+
 uniform vec3 light_position;
-uniform float light_radius;
+uniform float light_extrusion;
+
+// Note: caps are only required for depth-fail
+uniform bool caps;
 
 void emit(vec3 p) {
 
     // Project vertex
+#ifdef STEREO
+    vec4 pos = projection[gl_InvocationID] * view[gl_InvocationID] * vec4(p, 1.0);
+    gl_ViewportIndex = gl_InvocationID + 1;
+#else
     vec4 pos = projection * view * vec4(p, 1.0);
+#endif
 
     // Add bias to avoid z-fight
     pos.z += 0.00001 * pos.w;
@@ -22,49 +46,68 @@ void emit(vec3 p) {
     EmitVertex();
 }
 
+vec3 extrude(vec3 p) {
+    return p + normalize(p - light_position) * light_extrusion;
+}
+
+bool isLit(vec3 a, vec3 b, vec3 c) {
+    vec3 n = cross(b - a, c - a);
+    return dot(n, a - light_position) < 0.0;
+}
+
 void main() {
-    
-    // Get triangle coordinates
-    vec3 a = gl_in[0].gl_Position.xyz;
-    vec3 b = gl_in[1].gl_Position.xyz;
-    vec3 c = gl_in[2].gl_Position.xyz;
 
-    // Compute center of mass
-    vec3 d = (a + b + c) / 3.0;
+    // Get triangle coordinates, interleaved with neighbouring vertices
+    vec3 a = gl_in[0].gl_Position.xyz;
+    vec3 ab = gl_in[1].gl_Position.xyz;
+    vec3 b = gl_in[2].gl_Position.xyz;
+    vec3 bc = gl_in[3].gl_Position.xyz;
+    vec3 c = gl_in[4].gl_Position.xyz;
+    vec3 ca = gl_in[5].gl_Position.xyz;
 
-    // Compute normal and check orientation w.r.t. the light
-    vec3 n = cross(b - a, c - a);
-    if (dot(n, d - light_position) >= 0.0)
+    // Only faces oriented toward the light cast shadows
+    if (!isLit(a, b, c))
         return;
 
     // Extrude vertices w.r.t light position
-    vec3 ap = a + normalize(a - light_position) * (2.0 * light_radius);
-    vec3 bp = b + normalize(b - light_position) * (2.0 * light_radius);
-    vec3 cp = c + normalize(c - light_position) * (2.0 * light_radius);
-    vec3 dp = d + normalize(d - light_position) * (3.0 * light_radius);
-    
-    // TODO is it possible to do this using only one patch?
-
-    // Emit first patch
-    // c b cp bp dp ap cp a c b
-    emit(c);
-    emit(b);
-    emit(cp);
-    emit(bp);
-    emit(dp);
-    emit(ap);
-    emit(cp);
-    emit(a);
-    emit(c);
-    emit(b);
-    EndPrimitive();
-
-    // Emit second patch
-    // a ap b bp
-    emit(a);
-    emit(ap);
-    emit(b);
-    emit(bp);
-    EndPrimitive();
+    vec3 ap = extrude(a);
+    vec3 bp = extrude(b);
+    vec3 cp = extrude(c);
+
+    // Emit near cap and far cap, with reversed winding
+    if (caps) {
+        emit(a);
+        emit(b);
+        emit(c);
+        EndPrimitive();
+        emit(ap);
+        emit(cp);
+        emit(bp);
+        EndPrimitive();
+    }
+
+    // Emit sides on silhouette edges only, i.e. where the neighbouring face is not lit
+    // Note: each edge is shared by exactly one lit face, hence the volume is closed
+    if (!isLit(a, ab, b)) {
+        emit(a);
+        emit(ap);
+        emit(b);
+        emit(bp);
+        EndPrimitive();
+    }
+    if (!isLit(b, bc, c)) {
+        emit(b);
+        emit(bp);
+        emit(c);
+        emit(cp);
+        EndPrimitive();
+    }
+    if (!isLit(c, ca, a)) {
+        emit(c);
+        emit(cp);
+        emit(a);
+        emit(ap);
+        EndPrimitive();
+    }
 
 }
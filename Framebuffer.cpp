@@ -28,6 +28,11 @@ void Framebuffer::attach(Texture & texture) {
     }
 }
 
+void Framebuffer::attach(Texture & texture, GLuint face) {
+    assert(texture.isCube() && face < 6);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, texture.getHandle(), 0);
+}
+
 bool Framebuffer::validate() {
     
     // Enable all draw buffers
@@ -20,6 +20,7 @@ public:
     void bind();
     
     void attach(Texture & texture);
+    void attach(Texture & texture, GLuint face); // Note: only for depth cube maps
     
     bool validate();
     
@@ -0,0 +1,95 @@
+
+#include "Frustum.hpp"
+
+namespace {
+
+glm::vec3 intersect(glm::vec4 const & a, glm::vec4 const & b, glm::vec4 const & c) {
+    glm::vec3 na(a), nb(b), nc(c);
+    glm::vec3 bc = glm::cross(nb, nc);
+    return -(a.w * bc + b.w * glm::cross(nc, na) + c.w * glm::cross(na, nb)) / glm::dot(na, bc);
+}
+
+}
+
+Frustum::Frustum() {}
+
+Frustum::Frustum(glm::mat4 const & matrix) {
+    
+    // See Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix"
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 2; ++j) {
+            float sign = j == 0 ? 1.0f : -1.0f;
+            glm::vec4 plane;
+            for (int k = 0; k < 4; ++k)
+                plane[k] = matrix[k][3] + sign * matrix[k][i];
+            planes[i * 2 + j] = plane / glm::length(glm::vec3(plane));
+        }
+    
+    // Unproject normalized device coordinates cube
+    glm::mat4 inverse = glm::inverse(matrix);
+    for (int i = 0; i < 8; ++i) {
+        glm::vec4 corner = inverse * glm::vec4(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f, 1.0f);
+        corners[i] = glm::vec3(corner) / corner.w;
+    }
+}
+
+Frustum Frustum::merge(Frustum const & a, Frustum const & b) {
+    Frustum result;
+    for (int i = 0; i < 6; ++i) {
+        
+        // Push each candidate plane outward until it contains the other frustum
+        float shift_a = 0.0f;
+        float shift_b = 0.0f;
+        for (int j = 0; j < 8; ++j) {
+            shift_a = glm::max(shift_a, -glm::dot(glm::vec3(a.planes[i]), b.corners[j]) - a.planes[i].w);
+            shift_b = glm::max(shift_b, -glm::dot(glm::vec3(b.planes[i]), a.corners[j]) - b.planes[i].w);
+        }
+        
+        // Keep the tightest one
+        result.planes[i] = shift_a <= shift_b ? a.planes[i] + glm::vec4(0.0f, 0.0f, 0.0f, shift_a) : b.planes[i] + glm::vec4(0.0f, 0.0f, 0.0f, shift_b);
+    }
+    
+    // Compute new corners
+    for (int i = 0; i < 8; ++i)
+        result.corners[i] = intersect(result.planes[i & 1], result.planes[2 + ((i >> 1) & 1)], result.planes[4 + ((i >> 2) & 1)]);
+    return result;
+}
+
+glm::vec4 const & Frustum::getPlane(int index) const {
+    return planes[index];
+}
+
+glm::vec3 const & Frustum::getCorner(int index) const {
+    return corners[index];
+}
+
+bool Frustum::intersects(glm::vec3 const & center, float radius) const {
+    for (int i = 0; i < 6; ++i)
+        if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+            return false;
+    return true;
+}
+
+bool Frustum::intersects(glm::vec3 const & a, float radius_a, glm::vec3 const & b, float radius_b) const {
+    for (int i = 0; i < 6; ++i) {
+        glm::vec3 normal(planes[i]);
+        if (glm::dot(normal, a) + planes[i].w < -radius_a && glm::dot(normal, b) + planes[i].w < -radius_b)
+            return false;
+    }
+    return true;
+}
+
+void Frustum::intersects(size_t count, float const * x, float const * y, float const * z, float const * radius, uint8_t * visible) const {
+    for (size_t j = 0; j < count; ++j)
+        visible[j] = 1;
+    
+    // Plane by plane, so that the inner loop is easily vectorized
+    for (int i = 0; i < 6; ++i) {
+        float a = planes[i].x;
+        float b = planes[i].y;
+        float c = planes[i].z;
+        float d = planes[i].w;
+        for (size_t j = 0; j < count; ++j)
+            visible[j] &= a * x[j] + b * y[j] + c * z[j] + d >= -radius[j];
+    }
+}
@@ -0,0 +1,38 @@
+
+#ifndef GLOW_FRUSTUM_HPP
+#define GLOW_FRUSTUM_HPP
+
+#include "Common.hpp"
+
+class Frustum {
+public:
+    
+    Frustum();
+    
+    // Extract planes from a projection-view matrix
+    Frustum(glm::mat4 const & matrix);
+    
+    // Smallest frustum with planes parallel to the given ones that contains both
+    static Frustum merge(Frustum const & a, Frustum const & b);
+    
+    // Note: planes are left, right, bottom, top, near and far, with normals pointing inward
+    glm::vec4 const & getPlane(int index) const;
+    glm::vec3 const & getCorner(int index) const;
+    
+    bool intersects(glm::vec3 const & center, float radius) const;
+    
+    // Test convex hull of two spheres (e.g. a sphere swept along a segment)
+    bool intersects(glm::vec3 const & a, float radius_a, glm::vec3 const & b, float radius_b) const;
+    
+    // Test many spheres at once, given as structure of arrays
+    // Note: visibility flags are overwritten
+    void intersects(size_t count, float const * x, float const * y, float const * z, float const * radius, uint8_t * visible) const;
+    
+private:
+    
+    glm::vec4 planes[6];
+    glm::vec3 corners[8];
+    
+};
+
+#endif
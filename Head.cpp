@@ -9,6 +9,10 @@ glm::vec3 Head::getVelocity() const {
     return velocity;
 }
 
+uint64_t Head::getVersion() const {
+    return version;
+}
+
 uint32_t Head::getWidth() const {
     return width;
 }
@@ -28,3 +32,5 @@ Camera const * Head::getEyeLeft() const {
 Camera const * Head::getEyeRight() const {
     return &right;
 }
+
+Head::Head() : version(0) {}
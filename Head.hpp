@@ -14,6 +14,7 @@ public:
     
     glm::mat4 getTransform() const;
     glm::vec3 getVelocity() const;
+    uint64_t getVersion() const;
     
     uint32_t getWidth() const;
     uint32_t getHeight() const;
@@ -27,11 +28,12 @@ public:
 private:
     
     // Note: created and managed by Window
-    Head() = default;
+    Head();
     ~Head() = default;
     
     glm::mat4 transform;
     glm::vec3 velocity;
+    uint64_t version;
     Camera left;
     Camera right;
     
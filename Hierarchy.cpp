@@ -0,0 +1,113 @@
+
+#include "Hierarchy.hpp"
+
+#include <algorithm>
+
+Hierarchy::Hierarchy() : sorted(true) {}
+
+void Hierarchy::clear() {
+    added.clear();
+    sorted = false;
+}
+
+void Hierarchy::addActor(AttachableActor * actor) {
+    added.push_back(actor);
+    sorted = false;
+}
+
+void Hierarchy::update() {
+    
+    // Sort again if actors or links have changed
+    bool changed = !sorted;
+    for (size_t i = 0; !changed && i < added.size(); ++i)
+        changed = added[i]->parent != linked_parent[i];
+    if (changed)
+        sort();
+    
+    // Propagate world transforms, only where this actor or one of its ancestors has a new stamp
+    size_t count = actors.size();
+    for (size_t i = 0; i < count; ++i) {
+        AttachableActor * actor = actors[i];
+        int32_t parent = actor_parent_index[i];
+        uint64_t version = actor->version;
+        if (parent >= 0) {
+            version = std::max(version, actor_version[parent]);
+            if (version != actor_version[i])
+                actor_world[i] = actor_world[parent] * actor->transform;
+        } else if (actor->parent) {
+            version = std::max(version, actor->parent->getVersion());
+            if (version != actor_version[i])
+                actor_world[i] = actor->parent->getTransform() * actor->transform;
+        } else if (version != actor_version[i])
+            actor_world[i] = actor->transform;
+        
+        // Serve transform from cache until next modification
+        if (version != actor_version[i]) {
+            actor_version[i] = version;
+            actor->world = actor_world[i];
+            actor->world_version = version;
+        }
+    }
+}
+
+void Hierarchy::sort() {
+    
+    // Compute depth of each actor, i.e. number of attachable ancestors in this hierarchy
+    size_t count = added.size();
+    std::unordered_map<Actor const *, uint32_t> indices;
+    for (size_t i = 0; i < count; ++i)
+        indices[added[i]] = i;
+    std::vector<int32_t> depths(count, -1);
+    std::vector<uint32_t> chain;
+    for (size_t i = 0; i < count; ++i) {
+        
+        // Walk up until an actor with known depth, or a root
+        uint32_t index = i;
+        int32_t depth = 0;
+        while (depths[index] < 0) {
+            chain.push_back(index);
+            auto it = indices.find(added[index]->parent);
+            if (it == indices.end())
+                break;
+            index = it->second;
+        }
+        if (depths[index] >= 0)
+            depth = depths[index] + 1;
+        
+        // Assign depths back down the chain
+        while (!chain.empty()) {
+            depths[chain.back()] = depth++;
+            chain.pop_back();
+        }
+    }
+    
+    // Counting sort by depth, which keeps insertion order among siblings
+    int32_t max_depth = 0;
+    for (size_t i = 0; i < count; ++i)
+        max_depth = std::max(max_depth, depths[i]);
+    std::vector<uint32_t> offsets(max_depth + 2, 0);
+    for (size_t i = 0; i < count; ++i)
+        ++offsets[depths[i] + 1];
+    for (int32_t d = 0; d <= max_depth; ++d)
+        offsets[d + 1] += offsets[d];
+    actors.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        actors[offsets[depths[i]]++] = added[i];
+    
+    // Link to parents by index, now that they are known to come first
+    for (size_t i = 0; i < count; ++i)
+        indices[actors[i]] = i;
+    actor_parent_index.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        auto it = indices.find(actors[i]->parent);
+        actor_parent_index[i] = it == indices.end() ? -1 : it->second;
+    }
+    actor_world.resize(count);
+    actor_version.assign(count, 0);
+    
+    // Remember links, to detect changes
+    sorted = true;
+    linked_parent.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        linked_parent[i] = added[i]->parent;
+}
@@ -0,0 +1,44 @@
+
+#ifndef GLOW_HIERARCHY_HPP
+#define GLOW_HIERARCHY_HPP
+
+#include "Common.hpp"
+#include "Actor.hpp"
+
+// Flattened set of attachable actors, sorted so that parents come before their children
+class Hierarchy {
+public:
+    
+    Hierarchy();
+    
+    Hierarchy(Hierarchy const &) = delete;
+    Hierarchy & operator=(Hierarchy const &) = delete;
+    
+    // Note: actors are kept between frames, only clear and add them again when the set itself changes
+    void clear();
+    void addActor(AttachableActor * actor);
+    
+    // Propagate world transforms and store them in actors
+    // Note: only subtrees whose version changed are recomputed, parents that are not attachable (e.g. physics bodies) only provide their version and cached transform
+    void update();
+    
+private:
+    
+    void sort();
+    
+    std::vector<AttachableActor *> added;
+    bool sorted;
+    
+    // Parents at last sort, in insertion order
+    std::vector<Actor const *> linked_parent;
+    
+    // Sorted actors, as structure of arrays
+    // Note: version is the one world transform was last computed for
+    std::vector<AttachableActor *> actors;
+    std::vector<int32_t> actor_parent_index;
+    std::vector<glm::mat4> actor_world;
+    std::vector<uint64_t> actor_version;
+    
+};
+
+#endif
@@ -2,6 +2,7 @@
 #include "Image.hpp"
 
 #include <cstdio>
+#include <cstring>
 #include <setjmp.h>
 
 #ifndef GLOW_NO_PNG_ZLIB
@@ -29,8 +30,29 @@ GLuint const * Image::getPointer() const {
 }
 
 bool Image::load(std::string const & path) {
-    // TODO improve this based on extension
-    return loadBmp(path) || loadPng(path) || loadJpg(path);
+    
+    // Read signature, which is enough to identify supported formats
+    FILE * file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    unsigned char magic[8] = {0};
+    size_t size = fread(magic, 1, sizeof(magic), file);
+    fclose(file);
+    
+    // Select decoder
+    if (size >= 2 && magic[0] == 'B' && magic[1] == 'M')
+        return loadBmp(path);
+    if (size >= 8 && memcmp(magic, "\x89PNG\r\n\x1a\n", 8) == 0)
+        return loadPng(path);
+    if (size >= 3 && magic[0] == 0xff && magic[1] == 0xd8 && magic[2] == 0xff)
+        return loadJpg(path);
+    return false;
+}
+
+std::future<bool> Image::loadAsync(ThreadPool & pool, std::string const & path) {
+    return pool.async<bool>([this, path]() {
+        return load(path);
+    });
 }
 
 bool Image::loadBmp(std::string const & path) {
@@ -3,6 +3,7 @@
 #define GLOW_IMAGE_HPP
 
 #include "Common.hpp"
+#include "ThreadPool.hpp"
 
 class Image {
 public:
@@ -14,7 +15,13 @@ public:
     
     GLuint const * getPointer() const;
     
+    // Note: decoder is selected using magic bytes
     bool load(std::string const & path);
+    
+    // Decode on a worker thread, returning whether it succeeded once done
+    // Note: image must not be accessed, moved or destroyed before the result is ready
+    std::future<bool> loadAsync(ThreadPool & pool, std::string const & path);
+    
     bool loadBmp(std::string const & path);
     bool loadPng(std::string const & path);
     bool loadJpg(std::string const & path);
@@ -1,6 +1,8 @@
 
 #include "Light.hpp"
 
+Light::Light() : radius(1.0f), color(1.0f, 1.0f, 1.0f), shadow(true), mapped(false) {}
+
 float Light::getRadius() const {
     return radius;
 }
@@ -16,3 +18,19 @@ glm::vec3 Light::getColor() const {
 void Light::setColor(glm::vec3 const & color) {
     this->color = color;
 }
+
+bool Light::hasShadow() const {
+    return shadow;
+}
+
+void Light::setShadow(bool shadow) {
+    this->shadow = shadow;
+}
+
+bool Light::isShadowMapped() const {
+    return mapped;
+}
+
+void Light::setShadowMapped(bool mapped) {
+    this->mapped = mapped;
+}
@@ -10,18 +10,31 @@ public:
     
     // TODO other types of lights (directional, spot...)
     
+    Light();
+    
     float getRadius() const;
     void setRadius(float radius);
     
     glm::vec3 getColor() const;
     void setColor(glm::vec3 const & color);
     
+    // Note: lights without shadows can be shaded in batch
+    bool hasShadow() const;
+    void setShadow(bool shadow);
+    
+    // Use cube shadow map instead of shadow volumes, which trades memory for fill-rate
+    // Note: maps are cached as long as the light and its casters do not move
+    bool isShadowMapped() const;
+    void setShadowMapped(bool mapped);
+    
     // TODO visibility tests
     
 private:
 
     float radius;
     glm::vec3 color;
+    bool shadow;
+    bool mapped;
     
 };
 
@@ -6,6 +6,27 @@
 
 int main(int argc, char** argv) {
     
+    // Parse renderer switches
+    bool stereo = false;
+    bool compact = false;
+    bool tiled = false;
+    std::string profile;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--stereo")
+            stereo = true;
+        else if (argument == "--compact")
+            compact = true;
+        else if (argument == "--tiled")
+            tiled = true;
+        else if (argument == "--profile" && i + 1 < argc)
+            profile = argv[++i];
+        else {
+            std::cout << "Unknown argument " << argument << std::endl;
+            return -1;
+        }
+    }
+    
     // Create window
     Window window;
     if (!window.initialize(1024, 768, false, true))
@@ -14,9 +35,15 @@ int main(int argc, char** argv) {
     // Create game
     Scene
     //Smoke
-    game(&window);
+    game(&window, stereo, compact);
     if (!game.initialize())
         return -1;
+    game.getRenderer()->setTiled(tiled);
+    if (!profile.empty()) {
+        if (!game.getRenderer()->getProfiler()->setOutput(profile))
+            return -1;
+        game.getRenderer()->getProfiler()->setEnabled(true);
+    }
     
     // Game loop
     do {
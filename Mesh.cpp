@@ -1,78 +1,478 @@
 
 #include "Mesh.hpp"
+#include "ThreadPool.hpp"
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
-bool Mesh::load(std::string const & path) {
-    return loadObj(path);
+namespace {
+
+// Bump version whenever the layout changes, so that stale caches are discarded
+uint32_t const BINARY_MAGIC = 0x4d4f4c47; // "GLOM"
+uint32_t const BINARY_VERSION = 3;
+
+struct BinaryHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertices;
+    uint32_t faces;
+    uint32_t halfedges;
+    uint32_t indexedVertices;
+    uint32_t indexedElements;
+};
+
+template <typename T>
+bool readArray(FILE * file, std::vector<T> & array, uint32_t count) {
+    array.resize(count);
+    return count == 0 || fread(array.data(), sizeof(T), count, file) == count;
+}
+
+// Check that every index refers to an existing element, or is -1 where allowed
+template <typename T>
+bool checkIndices(std::vector<T> const & indices, int64_t low, int64_t high) {
+    for (T index : indices)
+        if ((int64_t)index < low || (int64_t)index >= high)
+            return false;
+    return true;
+}
+
+long getFileSize(FILE * file) {
+    long position = ftell(file);
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, position, SEEK_SET);
+    return size;
+}
+
+template <typename T>
+bool writeArray(FILE * file, std::vector<T> const & array) {
+    return array.empty() || fwrite(array.data(), sizeof(T), array.size(), file) == array.size();
+}
+
+// Full vertex attributes, compared bitwise to merge identical vertices
+struct IndexedVertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 coordinate;
+    
+    bool operator==(IndexedVertex const & other) const {
+        return memcmp(this, &other, sizeof(IndexedVertex)) == 0;
+    }
+};
+
+struct IndexedVertexHash {
+    size_t operator()(IndexedVertex const & vertex) const {
+        uint32_t words[8];
+        memcpy(words, &vertex, sizeof(words));
+        size_t hash = 0;
+        for (uint32_t word : words)
+            hash = hash * 31 + word;
+        return hash;
+    }
+};
+
+// Pop a vertex that still has pending triangles, either from dead-end stack or by scanning input
+GLint skipDeadEnd(std::vector<GLint> const & live, std::vector<GLint> & stack, GLint & cursor) {
+    while (!stack.empty()) {
+        GLint vertex = stack.back();
+        stack.pop_back();
+        if (live[vertex] > 0)
+            return vertex;
+    }
+    while (cursor < (GLint)live.size()) {
+        if (live[cursor] > 0)
+            return cursor;
+        ++cursor;
+    }
+    return -1;
 }
 
-bool Mesh::loadObj(std::string const & path) {
+// Reorder triangles to improve post-transform vertex cache usage
+// See Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (i.e. Tipsify)
+std::vector<GLuint> reorderTriangles(std::vector<GLuint> const & indices, GLuint vertices, GLint cacheSize) {
+    GLint triangles = indices.size() / 3;
+    
+    // Build vertex to triangle adjacency
+    std::vector<GLint> live(vertices, 0);
+    for (GLuint index : indices)
+        ++live[index];
+    std::vector<GLint> offsets(vertices + 1, 0);
+    for (GLuint v = 0; v < vertices; ++v)
+        offsets[v + 1] = offsets[v] + live[v];
+    std::vector<GLint> adjacency(indices.size());
+    std::vector<GLint> fill(offsets.begin(), offsets.end() - 1);
+    for (GLint t = 0; t < triangles; ++t)
+        for (GLint k = 0; k < 3; ++k)
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+    
+    // Greedily fan around vertices that are likely to be in cache
+    std::vector<GLint> timestamps(vertices, 0);
+    std::vector<bool> emitted(triangles, false);
+    std::vector<GLint> stack;
+    std::vector<GLint> candidates;
+    std::vector<GLuint> result;
+    result.reserve(indices.size());
+    GLint time = cacheSize + 1;
+    GLint cursor = 0;
+    GLint fanning = vertices > 0 ? 0 : -1;
+    while (fanning >= 0) {
+        
+        // Emit all remaining triangles around current vertex
+        candidates.clear();
+        for (GLint a = offsets[fanning]; a < offsets[fanning + 1]; ++a) {
+            GLint t = adjacency[a];
+            if (emitted[t])
+                continue;
+            for (GLint k = 0; k < 3; ++k) {
+                GLuint v = indices[t * 3 + k];
+                result.push_back(v);
+                stack.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - timestamps[v] > cacheSize)
+                    timestamps[v] = time++;
+            }
+            emitted[t] = true;
+        }
+        
+        // Select next vertex, preferring ones that will still be in cache
+        GLint best = -1;
+        GLint priority = -1;
+        for (GLint v : candidates)
+            if (live[v] > 0) {
+                GLint p = 0;
+                if (time - timestamps[v] + 2 * live[v] <= cacheSize)
+                    p = time - timestamps[v];
+                if (p > priority) {
+                    priority = p;
+                    best = v;
+                }
+            }
+        fanning = best >= 0 ? best : skipDeadEnd(live, stack, cursor);
+    }
+    return result;
+}
+
+// Files larger than this are split in chunks, which may be parsed concurrently
+size_t const OBJ_CHUNK_SIZE = 1 << 20;
+
+// Raw content of a range of lines, before any topology is built
+struct ObjChunk {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> coordinates;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::ivec3> corners; // zero-based position, coordinate and normal indices, -1 if absent
+    std::vector<GLint> sizes; // corners per face
+};
+
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline char const * skipBlanks(char const * p, char const * end) {
+    while (p < end && isBlank(*p))
+        ++p;
+    return p;
+}
+
+inline char const * skipLine(char const * p, char const * end) {
+    while (p < end && *p != '\n')
+        ++p;
+    return p < end ? p + 1 : end;
+}
+
+inline char const * parseInt(char const * p, char const * end, GLint & value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    GLint result = 0;
+    while (p < end && isDigit(*p))
+        result = result * 10 + (*p++ - '0');
+    value = negative ? -result : result;
+    return p;
+}
+
+inline char const * parseFloat(char const * p, char const * end, float & value) {
+    static double const powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    p = skipBlanks(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    
+    // Accumulate all significant digits as an integer
+    double mantissa = 0.0;
+    int exponent = 0;
+    while (p < end && isDigit(*p))
+        mantissa = mantissa * 10.0 + (*p++ - '0');
+    if (p < end && *p == '.') {
+        ++p;
+        while (p < end && isDigit(*p)) {
+            mantissa = mantissa * 10.0 + (*p++ - '0');
+            --exponent;
+        }
+    }
+    
+    // Apply explicit exponent, if any
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        GLint e;
+        p = parseInt(p + 1, end, e);
+        exponent += e;
+    }
+    if (exponent < 0)
+        mantissa = exponent >= -22 ? mantissa / powers[-exponent] : mantissa * std::pow(10.0, exponent);
+    else if (exponent > 0)
+        mantissa = exponent <= 22 ? mantissa * powers[exponent] : mantissa * std::pow(10.0, exponent);
+    value = (float)(negative ? -mantissa : mantissa);
+    return p;
+}
+
+void parseObj(char const * p, char const * end, ObjChunk & chunk) {
+    while (p < end) {
+        p = skipBlanks(p, end);
+        if (end - p > 1 && p[0] == 'v' && isBlank(p[1])) {
+            glm::vec3 v;
+            p = parseFloat(p + 1, end, v.x);
+            p = parseFloat(p, end, v.y);
+            p = parseFloat(p, end, v.z);
+            chunk.positions.push_back(v);
+        }
+        else if (end - p > 2 && p[0] == 'v' && p[1] == 't' && isBlank(p[2])) {
+            glm::vec2 c;
+            p = parseFloat(p + 2, end, c.x);
+            p = parseFloat(p, end, c.y);
+            chunk.coordinates.push_back(c);
+        }
+        else if (end - p > 2 && p[0] == 'v' && p[1] == 'n' && isBlank(p[2])) {
+            glm::vec3 n;
+            p = parseFloat(p + 2, end, n.x);
+            p = parseFloat(p, end, n.y);
+            p = parseFloat(p, end, n.z);
+            chunk.normals.push_back(n);
+        }
+        else if (end - p > 1 && p[0] == 'f' && isBlank(p[1])) {
+            GLint size = 0;
+            p = skipBlanks(p + 1, end);
+            while (p < end && *p != '\n' && *p != '#') {
+                glm::ivec3 corner(0, 0, 0);
+                p = parseInt(p, end, corner.x);
+                if (p < end && *p == '/') {
+                    if (++p < end && *p != '/')
+                        p = parseInt(p, end, corner.y);
+                    if (p < end && *p == '/')
+                        p = parseInt(p + 1, end, corner.z);
+                }
+                
+                // Stop on garbage, otherwise we would loop forever
+                if (p < end && !isBlank(*p) && *p != '\n' && *p != '#')
+                    break;
+                chunk.corners.push_back(corner - glm::ivec3(1, 1, 1));
+                ++size;
+                p = skipBlanks(p, end);
+            }
+            chunk.sizes.push_back(size);
+        }
+        p = skipLine(p, end);
+    }
+}
+
+}
+
+bool Mesh::load(std::string const & path, ThreadPool * pool) {
+    return loadObj(path, pool);
+}
+
+bool Mesh::loadObj(std::string const & path, ThreadPool * pool) {
     clear();
-    FILE * file = fopen(path.c_str(), "r");
+    
+    // Read whole file at once
+    FILE * file = fopen(path.c_str(), "rb");
     if (!file)
         return false;
-    char line[1024];
-    char tag[1024];
-    std::vector<glm::vec3> normals;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    std::vector<char> content(size);
+    if (size > 0 && fread(content.data(), size, 1, file) != 1) {
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+    
+    // Split large files on line boundaries
+    char const * begin = content.data();
+    char const * end = begin + size;
+    size_t count = size / OBJ_CHUNK_SIZE + 1;
+    std::vector<char const *> bounds;
+    bounds.push_back(begin);
+    for (size_t i = 1; i < count; ++i) {
+        char const * p = begin + size * i / count;
+        if (p < bounds.back())
+            p = bounds.back();
+        bounds.push_back(skipLine(p, end));
+    }
+    bounds.push_back(end);
+    
+    // Parse chunks on shared workers, if any, as several meshes may be loaded at once
+    std::vector<ObjChunk> chunks(count);
+    auto parse = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            parseObj(bounds[i], bounds[i + 1], chunks[i]);
+    };
+    if (pool)
+        pool->run(count, 1, parse);
+    else
+        parse(0, count);
+    
+    // Gather vertex attributes, as faces use global indices
+    size_t triangles = 0;
     std::vector<glm::vec2> coordinates;
-    while (fgets(line, sizeof(line), file))
-        if (sscanf(line, "%s", tag) == 1) {
-            if (strcmp(tag, "v") == 0) {
-                glm::vec3 p;
-                sscanf(line, "%*s %f %f %f", &p.x, &p.y, &p.z);
-                addVertex(p);
-            }
-            else if (strcmp(tag, "vt") == 0) {
-                glm::vec2 c;
-                sscanf(line, "%*s %f %f", &c.x, &c.y);
-                coordinates.push_back(c);
-            }
-            else if (strcmp(tag, "vn") == 0) {
-                glm::vec3 n;
-                sscanf(line, "%*s %f %f %f", &n.x, &n.y, &n.z);
-                normals.push_back(n);
-            }
-            else if (strcmp(tag, "f") == 0) {
-                std::vector<glm::ivec3> indices;
-                strtok(line, " \t");
-                while (char * part = strtok(NULL, " \t")) {
-                    glm::ivec3 indice(-1, -1, -1);
-                    char * s1 = strchr(part, '/');
-                    if (s1) {
-                        char * s2 = strchr(s1 + 1, '/');
-                        if (s2) {
-                            indice.z = strtol(s2 + 1, NULL, 10) - 1;
-                            *s2 = '\0';
-                        }
-                        indice.y = strtol(s1 + 1, NULL, 10) - 1;
-                        *s1 = '\0';
-                    }
-                    indice.x = strtol(part, NULL, 10) - 1;
-                    indices.push_back(indice);
-                }
-                for (size_t i = 2; i < indices.size(); ++i) {
-                    GLint p1 = indices[0].x;
-                    GLint p2 = indices[i - 1].x;
-                    GLint p3 = indices[i].x;
-                    glm::vec2 c(0, 0);
-                    glm::vec2 c1 = indices[0].y >= 0 ? coordinates[indices[0].y] : c;
-                    glm::vec2 c2 = indices[i - 1].y >= 0 ? coordinates[indices[i - 1].y] : c;
-                    glm::vec2 c3 = indices[i].y >= 0 ? coordinates[indices[i].y] : c;
-                    glm::vec3 n = glm::normalize(glm::cross(vertex_position[p2] - vertex_position[p1], vertex_position[p3] - vertex_position[p1]));
-                    glm::vec3 n1 = indices[0].z >= 0 ? normals[indices[0].z] : n;
-                    glm::vec3 n2 = indices[i - 1].z >= 0 ? normals[indices[i - 1].z] : n;
-                    glm::vec3 n3 = indices[i].z >= 0 ? normals[indices[i].z] : n;
-                    addFace(p1, p2, p3, n1, n2, n3, c1, c2, c3);
+    std::vector<glm::vec3> normals;
+    for (ObjChunk const & chunk : chunks) {
+        vertex_position.insert(vertex_position.end(), chunk.positions.begin(), chunk.positions.end());
+        coordinates.insert(coordinates.end(), chunk.coordinates.begin(), chunk.coordinates.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        for (GLint size : chunk.sizes)
+            if (size > 2)
+                triangles += size - 2;
+    }
+    vertex_halfedge.resize(vertex_position.size(), -1);
+    reserve(triangles);
+    
+    // Triangulate faces
+    GLint positionCount = vertex_position.size();
+    GLint coordinateCount = coordinates.size();
+    GLint normalCount = normals.size();
+    for (ObjChunk const & chunk : chunks) {
+        glm::ivec3 const * indices = chunk.corners.data();
+        for (GLint size : chunk.sizes) {
+            for (GLint i = 2; i < size; ++i) {
+                glm::ivec3 const & i1 = indices[0];
+                glm::ivec3 const & i2 = indices[i - 1];
+                glm::ivec3 const & i3 = indices[i];
+                if (i1.x < 0 || i1.x >= positionCount || i2.x < 0 || i2.x >= positionCount || i3.x < 0 || i3.x >= positionCount ||
+                    i1.y >= coordinateCount || i2.y >= coordinateCount || i3.y >= coordinateCount ||
+                    i1.z >= normalCount || i2.z >= normalCount || i3.z >= normalCount) {
+                    clear();
+                    return false;
                 }
+                glm::vec2 c(0, 0);
+                glm::vec2 c1 = i1.y >= 0 ? coordinates[i1.y] : c;
+                glm::vec2 c2 = i2.y >= 0 ? coordinates[i2.y] : c;
+                glm::vec2 c3 = i3.y >= 0 ? coordinates[i3.y] : c;
+                
+                // Face normal is only needed if some corner has no normal
+                glm::vec3 n(0, 0, 0);
+                if (i1.z < 0 || i2.z < 0 || i3.z < 0)
+                    n = glm::normalize(glm::cross(vertex_position[i2.x] - vertex_position[i1.x], vertex_position[i3.x] - vertex_position[i1.x]));
+                glm::vec3 n1 = i1.z >= 0 ? normals[i1.z] : n;
+                glm::vec3 n2 = i2.z >= 0 ? normals[i2.z] : n;
+                glm::vec3 n3 = i3.z >= 0 ? normals[i3.z] : n;
+                addFace(i1.x, i2.x, i3.x, n1, n2, n3, c1, c2, c3);
             }
+            indices += size;
         }
+    }
+    return true;
+}
+
+bool Mesh::loadBinary(std::string const & path) {
+    clear();
+    FILE * file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    
+    // Check header, and that counts match file size, as file may be truncated or corrupted
+    BinaryHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != BINARY_MAGIC || header.version != BINARY_VERSION) {
+        fclose(file);
+        return false;
+    }
+    uint64_t size = sizeof(header) +
+        (uint64_t)header.vertices * (sizeof(glm::vec3) + sizeof(GLint)) +
+        (uint64_t)header.faces * sizeof(GLint) +
+        (uint64_t)header.halfedges * (2 * sizeof(glm::vec3) + sizeof(glm::vec2) + 4 * sizeof(GLint)) +
+        (uint64_t)header.indexedVertices * (2 * sizeof(glm::vec3) + sizeof(glm::vec2)) +
+        (uint64_t)header.indexedElements * 3 * sizeof(GLuint);
+    if (header.halfedges != header.faces * (uint64_t)3 || (header.indexedElements != 0 && header.indexedElements != header.halfedges) || size != (uint64_t)getFileSize(file)) {
+        fclose(file);
+        return false;
+    }
+    
+    // Read flat arrays directly into storage, then check that indices are in range
+    bool valid =
+        readArray(file, vertex_position, header.vertices) &&
+        readArray(file, vertex_halfedge, header.vertices) &&
+        readArray(file, face_halfedge, header.faces) &&
+        readArray(file, halfedge_position, header.halfedges) &&
+        readArray(file, halfedge_normal, header.halfedges) &&
+        readArray(file, halfedge_coordinate, header.halfedges) &&
+        readArray(file, halfedge_next, header.halfedges) &&
+        readArray(file, halfedge_opposite, header.halfedges) &&
+        readArray(file, halfedge_vertex, header.halfedges) &&
+        readArray(file, halfedge_face, header.halfedges) &&
+        readArray(file, indexed_position, header.indexedVertices) &&
+        readArray(file, indexed_normal, header.indexedVertices) &&
+        readArray(file, indexed_coordinate, header.indexedVertices) &&
+        readArray(file, indexed_element, header.indexedElements) &&
+        readArray(file, indexed_adjacency, header.indexedElements * 2) &&
+        checkIndices(vertex_halfedge, -1, header.halfedges) &&
+        checkIndices(face_halfedge, 0, header.halfedges) &&
+        checkIndices(halfedge_next, 0, header.halfedges) &&
+        checkIndices(halfedge_opposite, -1, header.halfedges) &&
+        checkIndices(halfedge_vertex, 0, header.vertices) &&
+        checkIndices(halfedge_face, 0, header.faces) &&
+        checkIndices(indexed_element, 0, header.indexedVertices) &&
+        checkIndices(indexed_adjacency, 0, header.indexedVertices);
     fclose(file);
+    if (!valid) {
+        clear();
+        return false;
+    }
+    
+    // Note: edge lookup is only rebuilt if faces are added afterward
     return true;
 }
 
+bool Mesh::saveBinary(std::string const & path) const {
+    FILE * file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+    BinaryHeader header;
+    header.magic = BINARY_MAGIC;
+    header.version = BINARY_VERSION;
+    header.vertices = vertex_position.size();
+    header.faces = face_halfedge.size();
+    header.halfedges = halfedge_position.size();
+    header.indexedVertices = indexed_position.size();
+    header.indexedElements = indexed_element.size();
+    bool valid =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        writeArray(file, vertex_position) &&
+        writeArray(file, vertex_halfedge) &&
+        writeArray(file, face_halfedge) &&
+        writeArray(file, halfedge_position) &&
+        writeArray(file, halfedge_normal) &&
+        writeArray(file, halfedge_coordinate) &&
+        writeArray(file, halfedge_next) &&
+        writeArray(file, halfedge_opposite) &&
+        writeArray(file, halfedge_vertex) &&
+        writeArray(file, halfedge_face) &&
+        writeArray(file, indexed_position) &&
+        writeArray(file, indexed_normal) &&
+        writeArray(file, indexed_coordinate) &&
+        writeArray(file, indexed_element) &&
+        writeArray(file, indexed_adjacency);
+    fclose(file);
+    if (!valid)
+        remove(path.c_str());
+    return valid;
+}
+
 void Mesh::clear() {
     vertex_position.clear();
     vertex_halfedge.clear();
@@ -84,6 +484,12 @@ void Mesh::clear() {
     halfedge_opposite.clear();
     halfedge_vertex.clear();
     halfedge_face.clear();
+    halfedge_lookup.clear();
+    indexed_position.clear();
+    indexed_normal.clear();
+    indexed_coordinate.clear();
+    indexed_element.clear();
+    indexed_adjacency.clear();
 }
 
 GLint Mesh::addVertex(glm::vec3 const & position) {
@@ -98,21 +504,34 @@ GLint Mesh::addFace(GLint v1, GLint v2, GLint v3, glm::vec3 const & n1, glm::vec
     GLint h1 = halfedge_position.size();
     GLint h2 = h1 + 1;
     GLint h3 = h1 + 2;
-    GLint o1 = -1;
-    GLint o2 = -1;
-    GLint o3 = -1;
-    for (GLint h = 0; h < h1; ++h) {
-        // TODO properly handle incoherent winding (maybe ignore and provide a method to fix this)
-        assert(halfedge_vertex[h] != v1 || halfedge_vertex[halfedge_next[h]] != v2);
-        assert(halfedge_vertex[h] != v2 || halfedge_vertex[halfedge_next[h]] != v3);
-        assert(halfedge_vertex[h] != v3 || halfedge_vertex[halfedge_next[h]] != v1);
-        if (halfedge_vertex[h] == v2 && halfedge_vertex[halfedge_next[h]] == v1)
-            o1 = h;
-        if (halfedge_vertex[h] == v3 && halfedge_vertex[halfedge_next[h]] == v2)
-            o2 = h;
-        if (halfedge_vertex[h] == v1 && halfedge_vertex[halfedge_next[h]] == v3)
-            o3 = h;
-    }
+    
+    // Indices are no longer valid
+    indexed_position.clear();
+    indexed_normal.clear();
+    indexed_coordinate.clear();
+    indexed_element.clear();
+    indexed_adjacency.clear();
+    
+    // Lookup is not stored in binary files
+    if (halfedge_lookup.empty() && h1 > 0)
+        buildLookup();
+    
+    // TODO properly handle incoherent winding (maybe ignore and provide a method to fix this)
+    assert(halfedge_lookup.find(getEdgeKey(v1, v2)) == halfedge_lookup.end());
+    assert(halfedge_lookup.find(getEdgeKey(v2, v3)) == halfedge_lookup.end());
+    assert(halfedge_lookup.find(getEdgeKey(v3, v1)) == halfedge_lookup.end());
+    
+    // Find opposite half-edges, if already defined
+    auto it = halfedge_lookup.find(getEdgeKey(v2, v1));
+    GLint o1 = it != halfedge_lookup.end() ? it->second : -1;
+    it = halfedge_lookup.find(getEdgeKey(v3, v2));
+    GLint o2 = it != halfedge_lookup.end() ? it->second : -1;
+    it = halfedge_lookup.find(getEdgeKey(v1, v3));
+    GLint o3 = it != halfedge_lookup.end() ? it->second : -1;
+    halfedge_lookup[getEdgeKey(v1, v2)] = h1;
+    halfedge_lookup[getEdgeKey(v2, v3)] = h2;
+    halfedge_lookup[getEdgeKey(v3, v1)] = h3;
+    
     halfedge_position.push_back(vertex_position[v1]);
     halfedge_position.push_back(vertex_position[v2]);
     halfedge_position.push_back(vertex_position[v3]);
@@ -128,6 +547,12 @@ GLint Mesh::addFace(GLint v1, GLint v2, GLint v3, glm::vec3 const & n1, glm::vec
     halfedge_opposite.push_back(o1);
     halfedge_opposite.push_back(o2);
     halfedge_opposite.push_back(o3);
+    if (o1 >= 0)
+        halfedge_opposite[o1] = h1;
+    if (o2 >= 0)
+        halfedge_opposite[o2] = h2;
+    if (o3 >= 0)
+        halfedge_opposite[o3] = h3;
     halfedge_vertex.push_back(v1);
     halfedge_vertex.push_back(v2);
     halfedge_vertex.push_back(v3);
@@ -152,6 +577,29 @@ GLint Mesh::addFace(GLint v1, GLint v2, GLint v3) {
     return addFace(v1, v2, v3, n);
 }
 
+uint64_t Mesh::getEdgeKey(GLint from, GLint to) {
+    return ((uint64_t)(uint32_t)from << 32) | (uint32_t)to;
+}
+
+void Mesh::reserve(size_t faces) {
+    face_halfedge.reserve(faces);
+    halfedge_position.reserve(faces * 3);
+    halfedge_normal.reserve(faces * 3);
+    halfedge_coordinate.reserve(faces * 3);
+    halfedge_next.reserve(faces * 3);
+    halfedge_opposite.reserve(faces * 3);
+    halfedge_vertex.reserve(faces * 3);
+    halfedge_face.reserve(faces * 3);
+    halfedge_lookup.reserve(faces * 3);
+}
+
+void Mesh::buildLookup() {
+    halfedge_lookup.clear();
+    halfedge_lookup.reserve(halfedge_vertex.size());
+    for (GLint h = 0; h < (GLint)halfedge_vertex.size(); ++h)
+        halfedge_lookup[getEdgeKey(halfedge_vertex[h], halfedge_vertex[halfedge_next[h]])] = h;
+}
+
 GLint Mesh::getCount() const {
     return halfedge_position.size();
 }
@@ -167,3 +615,104 @@ glm::vec3 const * Mesh::getNormals() const {
 glm::vec2 const * Mesh::getCoordinates() const {
     return halfedge_coordinate.data();
 }
+
+glm::vec4 Mesh::getBoundingSphere() const {
+    if (halfedge_position.empty())
+        return glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 low = halfedge_position[0];
+    glm::vec3 high = halfedge_position[0];
+    for (glm::vec3 const & p : halfedge_position) {
+        low = glm::min(low, p);
+        high = glm::max(high, p);
+    }
+    glm::vec3 center = (low + high) * 0.5f;
+    float radius = 0.0f;
+    for (glm::vec3 const & p : halfedge_position)
+        radius = glm::max(radius, glm::length(p - center));
+    return glm::vec4(center, radius);
+}
+
+void Mesh::buildIndices() {
+    if (hasIndices())
+        return;
+    
+    // Merge identical vertices
+    std::unordered_map<IndexedVertex, GLuint, IndexedVertexHash> lookup;
+    lookup.reserve(halfedge_position.size());
+    std::vector<IndexedVertex> vertices;
+    std::vector<GLuint> indices(halfedge_position.size());
+    for (size_t h = 0; h < halfedge_position.size(); ++h) {
+        IndexedVertex vertex;
+        vertex.position = halfedge_position[h];
+        vertex.normal = halfedge_normal[h];
+        vertex.coordinate = halfedge_coordinate[h];
+        auto it = lookup.find(vertex);
+        if (it == lookup.end()) {
+            it = lookup.insert({vertex, (GLuint)vertices.size()}).first;
+            vertices.push_back(vertex);
+        }
+        indices[h] = it->second;
+    }
+    
+    // Optimize triangle order for a typical 16-entries vertex cache
+    indexed_element = reorderTriangles(indices, vertices.size(), 16);
+    
+    // Sort vertices by first use to improve fetch locality
+    std::vector<GLint> remap(vertices.size(), -1);
+    GLuint count = 0;
+    indexed_position.resize(vertices.size());
+    indexed_normal.resize(vertices.size());
+    indexed_coordinate.resize(vertices.size());
+    for (GLuint & index : indexed_element) {
+        if (remap[index] < 0) {
+            remap[index] = count;
+            indexed_position[count] = vertices[index].position;
+            indexed_normal[count] = vertices[index].normal;
+            indexed_coordinate[count] = vertices[index].coordinate;
+            ++count;
+        }
+        index = remap[index];
+    }
+    
+    // For each edge, add the vertex opposite to it in the neighbouring face
+    // Note: on borders, the face's own vertex is used, so that the edge is always a silhouette
+    indexed_adjacency.resize(halfedge_position.size() * 2);
+    for (size_t f = 0; f < face_halfedge.size(); ++f) {
+        GLint h = face_halfedge[f];
+        for (int i = 0; i < 3; ++i) {
+            GLint o = halfedge_opposite[h];
+            GLint e = o >= 0 ? halfedge_next[halfedge_next[o]] : halfedge_next[halfedge_next[h]];
+            indexed_adjacency[f * 6 + i * 2] = remap[indices[h]];
+            indexed_adjacency[f * 6 + i * 2 + 1] = remap[indices[e]];
+            h = halfedge_next[h];
+        }
+    }
+}
+
+bool Mesh::hasIndices() const {
+    return !indexed_element.empty() || halfedge_position.empty();
+}
+
+GLint Mesh::getIndexedCount() const {
+    return indexed_position.size();
+}
+
+glm::vec3 const * Mesh::getIndexedPositions() const {
+    return indexed_position.data();
+}
+
+glm::vec3 const * Mesh::getIndexedNormals() const {
+    return indexed_normal.data();
+}
+
+glm::vec2 const * Mesh::getIndexedCoordinates() const {
+    return indexed_coordinate.data();
+}
+
+GLuint const * Mesh::getIndices() const {
+    return indexed_element.data();
+}
+
+GLuint const * Mesh::getAdjacencyIndices() const {
+    return indexed_adjacency.data();
+}
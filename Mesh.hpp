@@ -4,15 +4,22 @@
 
 #include "Common.hpp"
 
+class ThreadPool;
+
 class Mesh {
 public:
     
     // TODO handle skinning weights and skeleton, or use a different class?
     
-    bool load(std::string const & path);
-    bool loadObj(std::string const & path);
+    // Note: large files are parsed in chunks, concurrently if a pool is given
+    bool load(std::string const & path, ThreadPool * pool = nullptr);
+    bool loadObj(std::string const & path, ThreadPool * pool = nullptr);
     // TODO STL, PLY?
     
+    // Compact binary representation of the whole half-edge structure, used as load cache
+    bool loadBinary(std::string const & path);
+    bool saveBinary(std::string const & path) const;
+    
     void clear();
     
     GLint addVertex(glm::vec3 const & position);
@@ -29,11 +36,29 @@ public:
     glm::vec3 const * getPositions() const;
     glm::vec3 const * getNormals() const;
     glm::vec2 const * getCoordinates() const;
-    // TODO get element indices for adjacency
+    
+    // Sphere enclosing all faces, as center and radius
+    // Note: computed on each call
+    glm::vec4 getBoundingSphere() const;
+    
+    // Indexed vertices data, where identical vertices are merged
+    // Note: must be built explicitly, and is discarded when faces are added
+    void buildIndices();
+    bool hasIndices() const;
+    GLint getIndexedCount() const;
+    glm::vec3 const * getIndexedPositions() const;
+    glm::vec3 const * getIndexedNormals() const;
+    glm::vec2 const * getIndexedCoordinates() const;
+    GLuint const * getIndices() const; // Note: there are getCount() indices
+    GLuint const * getAdjacencyIndices() const; // Note: there are 2 * getCount() indices, for GL_TRIANGLES_ADJACENCY
     
 private:
     
     // TODO face/vertex normals?
+    
+    static uint64_t getEdgeKey(GLint from, GLint to);
+    void reserve(size_t faces);
+    void buildLookup();
 
     std::vector<glm::vec3> vertex_position;
     std::vector<GLint> vertex_halfedge;
@@ -48,6 +73,15 @@ private:
     std::vector<GLint> halfedge_vertex;
     std::vector<GLint> halfedge_face;
     
+    std::vector<glm::vec3> indexed_position;
+    std::vector<glm::vec3> indexed_normal;
+    std::vector<glm::vec2> indexed_coordinate;
+    std::vector<GLuint> indexed_element;
+    std::vector<GLuint> indexed_adjacency;
+    
+    // Directed edge (i.e. pair of vertices) to half-edge, used to find opposites in constant time
+    std::unordered_map<uint64_t, GLint> halfedge_lookup;
+    
 };
 
 #endif
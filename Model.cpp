@@ -1,2 +1,4 @@
 
 #include "Model.hpp"
+
+Model::Model() : mesh(0), color(0), caster(true), rigid(false) {}
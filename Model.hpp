@@ -9,8 +9,12 @@ public:
     
     // TODO model class, with proper mesh/texture abstraction
     
+    Model();
+    
     uint32_t mesh;
     uint32_t color;
+    bool caster; // Note: whether model casts shadows
+    bool rigid; // Note: whether world transform only rotates and translates, so that its normal matrix is its upper 3x3
     
 private:
 
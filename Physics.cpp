@@ -27,4 +27,8 @@ Physics::~Physics() {
 
 void Physics::update(float delta) {
     world->stepSimulation(delta, 10);
+    
+    // Fetch transforms once, so that actors attached to bodies do not query simulation
+    for (Body * body : bodies)
+        body->synchronize();
 }
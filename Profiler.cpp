@@ -0,0 +1,115 @@
+
+#include "Profiler.hpp"
+
+Profiler::Profiler() : enabled(false), active(false), counts{}, frames{}, frame(0), pending(1), result_frame(0) {}
+
+Profiler::~Profiler() {
+    for (uint32_t i = 0; i < SET_COUNT; ++i)
+        if (!queries[i].empty())
+            glDeleteQueries(queries[i].size(), queries[i].data());
+}
+
+bool Profiler::isEnabled() const {
+    return enabled;
+}
+
+void Profiler::setEnabled(bool enabled) {
+    assert(!active);
+    this->enabled = enabled;
+}
+
+void Profiler::beginFrame() {
+    if (!enabled)
+        return;
+    ++frame;
+    
+    // Read back completed frames in order
+    while (pending < frame && collect(pending % SET_COUNT, false))
+        ++pending;
+    
+    // Set to be reused must have been read, wait for it only if the GPU is that late
+    uint32_t set = frame % SET_COUNT;
+    if (frame - pending >= SET_COUNT) {
+        collect(set, true);
+        ++pending;
+    }
+    counts[set] = 0;
+    frames[set] = frame;
+}
+
+void Profiler::beginSection(std::string const & name) {
+    if (!enabled)
+        return;
+    assert(!active);
+    uint32_t set = frame % SET_COUNT;
+    uint32_t index = counts[set]++;
+    if (index == queries[set].size()) {
+        GLuint query;
+        glGenQueries(1, &query);
+        assert(query);
+        queries[set].push_back(query);
+        names[set].push_back(name);
+    } else
+        names[set][index] = name;
+    glBeginQuery(GL_TIME_ELAPSED, queries[set][index]);
+    active = true;
+}
+
+void Profiler::endSection() {
+    if (!enabled)
+        return;
+    assert(active);
+    glEndQuery(GL_TIME_ELAPSED);
+    active = false;
+}
+
+uint64_t Profiler::getFrame() const {
+    return result_frame;
+}
+
+std::vector<Profiler::Section> const & Profiler::getSections() const {
+    return results;
+}
+
+bool Profiler::setOutput(std::string const & path) {
+    if (output.is_open())
+        output.close();
+    if (path.empty())
+        return true;
+    output.open(path, std::ios::out | std::ios::app);
+    if (!output) {
+        std::cout << "Failed to open profiler output " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Profiler::collect(uint32_t set, bool wait) {
+    if (counts[set] == 0)
+        return true;
+    
+    // Sections of a frame share the same order, hence only the last one needs to be checked
+    if (!wait) {
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(queries[set][counts[set] - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+    }
+    
+    // Convert nanoseconds to milliseconds
+    results.resize(counts[set]);
+    for (uint32_t i = 0; i < counts[set]; ++i) {
+        GLuint64 elapsed;
+        glGetQueryObjectui64v(queries[set][i], GL_QUERY_RESULT, &elapsed);
+        results[i].name = names[set][i];
+        results[i].time = elapsed * 1e-6;
+    }
+    result_frame = frames[set];
+    
+    // Dump to file, if requested
+    if (output.is_open())
+        for (Section const & section : results)
+            output << result_frame << ',' << section.name << ',' << section.time << '\n';
+    counts[set] = 0;
+    return true;
+}
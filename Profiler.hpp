@@ -0,0 +1,65 @@
+
+#ifndef GLOW_PROFILER_HPP
+#define GLOW_PROFILER_HPP
+
+#include "Common.hpp"
+
+#include <fstream>
+
+// GPU time spent in named sections of a frame, measured with timer queries
+class Profiler {
+public:
+    
+    Profiler();
+    ~Profiler();
+    
+    Profiler(Profiler const &) = delete;
+    Profiler & operator=(Profiler const &) = delete;
+    
+    // Note: disabled by default, in which case sections are ignored
+    bool isEnabled() const;
+    void setEnabled(bool enabled);
+    
+    // Note: results are read back once available, so that the pipeline is not stalled, and no frame is dropped
+    void beginFrame();
+    
+    // Note: sections cannot be nested, as time elapsed queries cannot overlap
+    void beginSection(std::string const & name);
+    void endSection();
+    
+    // Results of the last completed frame, in milliseconds
+    struct Section {
+        std::string name;
+        double time;
+    };
+    uint64_t getFrame() const;
+    std::vector<Section> const & getSections() const;
+    
+    // Append each completed frame as CSV rows (frame, section, milliseconds), or stop if path is empty
+    bool setOutput(std::string const & path);
+    
+private:
+    
+    bool collect(uint32_t set, bool wait);
+    
+    bool enabled;
+    bool active;
+    
+    // Ring of query sets, one being recorded while the others are in flight
+    // Note: a set is only recorded again once its results have been read
+    static uint32_t const SET_COUNT = 4;
+    std::vector<GLuint> queries[SET_COUNT];
+    std::vector<std::string> names[SET_COUNT];
+    uint32_t counts[SET_COUNT];
+    uint64_t frames[SET_COUNT];
+    uint64_t frame;
+    uint64_t pending; // Oldest frame not read yet
+    
+    uint64_t result_frame;
+    std::vector<Section> results;
+    
+    std::ofstream output;
+    
+};
+
+#endif
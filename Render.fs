@@ -5,16 +5,43 @@ in vec3 v_normal;
 in vec2 v_coordinate;
 in vec4 v_extra;
 
+#ifdef COMPACT
+
+// Position is reconstructed from depth, and normal is octahedral-encoded
+layout(location = 0) out vec4 color;
+layout(location = 1) out vec2 normal;
+layout(location = 2) out vec4 light;
+
+#else
+
 layout(location = 0) out vec4 color;
 layout(location = 1) out vec4 position;
 layout(location = 2) out vec4 normal;
 layout(location = 3) out vec4 light;
 
+#endif
+
 uniform sampler2DArray textures;
 
+#ifdef COMPACT
+
+// See Cigolle et al., "A Survey of Efficient Representations for Independent Unit Vectors"
+vec2 encode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 s = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * s;
+    return e * 0.5 + 0.5;
+}
+
+#endif
+
 void main() {
     color = texture(textures, vec3(v_coordinate, v_extra.x));
+#ifdef COMPACT
+    normal = encode(normalize(v_normal));
+#else
     position = vec4(v_position, 1.0);
     normal = vec4(v_normal, 0.0);
+#endif
     light = vec4(0.0, 0.0, 0.0, 1.0);
 }
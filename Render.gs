@@ -0,0 +1,35 @@
+#version 330 core
+#extension GL_ARB_gpu_shader5 : require
+#extension GL_ARB_viewport_array : require
+
+// Emit each triangle once per eye, using side-by-side viewports
+// Note: viewport 0 covers both eyes, and is used for screen-space passes
+layout (triangles, invocations = 2) in;
+layout (triangle_strip, max_vertices = 3) out;
+
+in vec3 g_position[];
+in vec3 g_normal[];
+in vec2 g_coordinate[];
+in vec4 g_extra[];
+
+out vec3 v_position;
+out vec3 v_normal;
+out vec2 v_coordinate;
+out vec4 v_extra;
+
+uniform mat4 projection[2];
+uniform mat4 view[2];
+
+void main() {
+    mat4 view_projection = projection[gl_InvocationID] * view[gl_InvocationID];
+    for (int i = 0; i < 3; ++i) {
+        gl_Position = view_projection * gl_in[i].gl_Position;
+        gl_ViewportIndex = gl_InvocationID + 1;
+        v_position = g_position[i];
+        v_normal = g_normal[i];
+        v_coordinate = g_coordinate[i];
+        v_extra = g_extra[i];
+        EmitVertex();
+    }
+    EndPrimitive();
+}
@@ -5,19 +5,37 @@ layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 coordinate;
 layout(location = 3) in mat4 model;
 layout(location = 7) in vec4 extra;
+layout(location = 8) in mat3 normal_matrix;
+
+#ifdef STEREO
+
+// Note: projection is done for each eye by the geometry shader, which forwards attributes
+#define v_position g_position
+#define v_normal g_normal
+#define v_coordinate g_coordinate
+#define v_extra g_extra
+
+#else
+
+uniform mat4 projection;
+uniform mat4 view;
+
+#endif
 
 out vec3 v_position;
 out vec3 v_normal;
 out vec2 v_coordinate;
 out vec4 v_extra;
 
-uniform mat4 projection;
-uniform mat4 view;
-
 void main() {
-    gl_Position = projection * view * model * vec4(position, 1.0);
-    v_position = (model * vec4(position, 1.0)).xyz;
-    v_normal = (transpose(inverse(model)) * vec4(normal, 0.0)).xyz;
+    vec4 p = model * vec4(position, 1.0);
+#ifdef STEREO
+    gl_Position = p;
+#else
+    gl_Position = projection * view * p;
+#endif
+    v_position = p.xyz;
+    v_normal = normal_matrix * normal;
     v_coordinate = coordinate;
     v_extra = extra;
 }
@@ -2,29 +2,116 @@
 #include "Renderer.hpp"
 #include "Shader.hpp"
 
-Renderer::Renderer() : textures(nullptr) {}
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sys/stat.h>
 
-Renderer::~Renderer() {
-    delete textures;
+namespace {
+
+// Number of models processed by each job in prepare
+size_t const PREPARE_CHUNK = 1024;
+
+// Size of screen tiles in pixels, used to bin lights without shadows
+GLuint const TILE_SIZE = 16;
+
+// Shadow volumes are extruded up to this multiple of light radius
+float const EXTRUSION_SCALE = 2.0f;
+
+// Maximum number of cached light contributions, as each one is a full screen texture
+size_t const LIGHT_CACHE_SIZE = 8;
+
+// Largest resident level of streamed textures at startup, and upload budget per frame in bytes
+GLuint const STREAMING_SIZE = 64;
+GLuint const STREAMING_BUDGET = 4 << 20;
+
+// Shadow map size bounds, actual size depends on light screen coverage
+GLuint const SHADOW_MIN_SIZE = 64;
+GLuint const SHADOW_MAX_SIZE = 1024;
+
+// Shadow map near plane, relative to light radius
+float const SHADOW_NEAR = 0.01f;
+
+// Cube map faces direction and up vectors, following OpenGL conventions
+glm::vec3 const SHADOW_FACES[6][2] = {
+    {{1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}},
+    {{-1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}},
+    {{0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+    {{0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, -1.0f}},
+    {{0.0f, 0.0f, 1.0f}, {0.0f, -1.0f, 0.0f}},
+    {{0.0f, 0.0f, -1.0f}, {0.0f, -1.0f, 0.0f}}
+};
+
+// FNV-1a hash, used to detect changes
+uint64_t hash(void const * data, size_t size, uint64_t seed = 14695981039346656037ULL) {
+    uint8_t const * bytes = (uint8_t const *)data;
+    for (size_t i = 0; i < size; ++i)
+        seed = (seed ^ bytes[i]) * 1099511628211ULL;
+    return seed;
 }
 
-bool Renderer::initialize(uint32_t width, uint32_t height) {
+// Distance from point to segment
+float getDistance(glm::vec3 const & point, glm::vec3 const & a, glm::vec3 const & b) {
+    glm::vec3 ab = b - a;
+    float length = glm::dot(ab, ab);
+    float t = length > 0.0f ? glm::clamp(glm::dot(point - a, ab) / length, 0.0f, 1.0f) : 0.0f;
+    return glm::length(point - (a + ab * t));
+}
+
+// Level at which an image is small enough to be resident at startup
+GLuint getStreamingLevel(GLuint width, GLuint height) {
+    GLuint level = 0;
+    while ((std::max(width, height) >> level) > STREAMING_SIZE)
+        ++level;
+    return level;
+}
+
+// Check whether derived file exists and is not older than its source
+bool isUpToDate(std::string const & source, std::string const & derived) {
+    struct stat s, d;
+    if (stat(derived.c_str(), &d) != 0)
+        return false;
+    if (stat(source.c_str(), &s) != 0)
+        return true;
+    return d.st_mtime >= s.st_mtime;
+}
+
+}
+
+Renderer::Renderer() : compact(false), stereo(false), cached(false), view_signature(0), compressed(false), packed(false), streaming(false), tiled(false), pool(ThreadPool::getDefaultWorkerCount()), uploader(pool) {}
+
+Renderer::~Renderer() {}
+
+bool Renderer::initialize(uint32_t width, uint32_t height, bool compact, bool stereo) {
     // TODO handle errors
+    this->width = width;
+    this->height = height;
+    this->compact = compact;
+    this->stereo = stereo;
+    std::string defines = std::string(compact ? "#define COMPACT\n" : "") + (stereo ? "#define STEREO\n" : "");
+    
+    // Use block-compressed textures when available
+    compressed = GLEW_EXT_texture_compression_s3tc != 0;
+    
+    // In stereo, both eyes are stored side-by-side
+    uint32_t target = stereo ? width * 2 : width;
     
     // Load depth-only rendering shader
-    render_shader.addSourceFile(GL_VERTEX_SHADER, "Render.vs");
-    render_shader.addSourceFile(GL_FRAGMENT_SHADER, "Render.fs");
+    render_shader.addSourceFile(GL_VERTEX_SHADER, "Render.vs", defines);
+    if (stereo)
+        render_shader.addSourceFile(GL_GEOMETRY_SHADER, "Render.gs");
+    render_shader.addSourceFile(GL_FRAGMENT_SHADER, "Render.fs", defines);
     render_shader.link();
 
     // Load shadow volume extrusion shader
     extrusion_shader.addSourceFile(GL_VERTEX_SHADER, "Extrusion.vs");
-    extrusion_shader.addSourceFile(GL_GEOMETRY_SHADER, "Extrusion.gs");
+    extrusion_shader.addSourceFile(GL_GEOMETRY_SHADER, "Extrusion.gs", defines);
     extrusion_shader.addSourceFile(GL_FRAGMENT_SHADER, "Extrusion.fs");
     extrusion_shader.link();
 
     // Load shading shader
     shading_shader.addSourceFile(GL_VERTEX_SHADER, "Processing.vs");
-    shading_shader.addSourceFile(GL_FRAGMENT_SHADER, "Shading.fs");
+    shading_shader.addSourceFile(GL_FRAGMENT_SHADER, "Shading.fs", defines);
     shading_shader.link();
     
     // Load finalization shader
@@ -37,15 +124,44 @@ bool Renderer::initialize(uint32_t width, uint32_t height) {
     antialiasing_shader.addSourceFile(GL_FRAGMENT_SHADER, "Antialiasing.fs");
     antialiasing_shader.link();
     
+    // Load tiled shading shader
+    tiled_shader.addSourceFile(GL_VERTEX_SHADER, "Processing.vs");
+    tiled_shader.addSourceFile(GL_FRAGMENT_SHADER, "Tiled.fs", defines);
+    tiled_shader.link();
+    
+    // Load shadow map shader
+    // Note: only depth is written
+    shadow_shader.addSourceFile(GL_VERTEX_SHADER, "Shadow.vs");
+    shadow_shader.addSourceFile(GL_FRAGMENT_SHADER, "Extrusion.fs");
+    shadow_shader.link();
+    
+    // Load copy shader, used to add cached light contributions
+    copy_shader.addSourceFile(GL_VERTEX_SHADER, "Processing.vs");
+    copy_shader.addSourceFile(GL_FRAGMENT_SHADER, "Duplication.fs");
+    copy_shader.link();
+    
+    // Disable color output of shadow maps framebuffer
+    // Note: depth attachment is set for each cube face when rendering
+    shadow_framebuffer.bind();
+    shadow_framebuffer.validate();
+    
     // Create render target
-    render_color.createColor(width, height, true);
-    render_position.createColor(width, height, true);
-    render_normal.createColor(width, height, true);
-    render_light.createColor(width, height, true);
-    render_depthStencil.createDepthStencil(width, height);
+    if (compact) {
+        render_color.createColor(target, height, false);
+        render_normal.createColor(target, height, GL_RG16, GL_RG, GL_UNSIGNED_SHORT);
+    } else {
+        render_color.createColor(target, height, true);
+        render_position.createColor(target, height, true);
+        render_normal.createColor(target, height, true);
+    }
+    render_light.createColor(target, height, true);
+    render_depthStencil.createDepthStencil(target, height);
+    if (compact)
+        render_depth.createDepthStencil(target, height);
     render_framebuffer.bind();
     render_framebuffer.attach(render_color);
-    render_framebuffer.attach(render_position);
+    if (!compact)
+        render_framebuffer.attach(render_position);
     render_framebuffer.attach(render_normal);
     render_framebuffer.attach(render_light);
     render_framebuffer.attach(render_depthStencil);
@@ -57,16 +173,27 @@ bool Renderer::initialize(uint32_t width, uint32_t height) {
     
     // Create processing targets
     for (int i = 0; i < 3; ++i) {
-        processing_color[i].createColor(width, height, true);
+        processing_color[i].createColor(target, height, true);
         processing_framebuffer[i].bind();
         processing_framebuffer[i].attach(processing_color[i]);
         processing_framebuffer[i].validate();
     }
     
-    // Load "default" mesh 0 used for processing
-    loadMesh("Square.obj");
+    // Create tiled shading buffers
+    tile_columns = (target + TILE_SIZE - 1) / TILE_SIZE;
+    tile_rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+    tile_lights_buffer.bind(GL_TEXTURE_BUFFER);
+    tile_lights_buffer.setData(0, nullptr, GL_STREAM_DRAW);
+    tile_lights_texture.createBuffer(tile_lights_buffer, GL_RGBA32F);
+    tile_ranges_buffer.bind(GL_TEXTURE_BUFFER);
+    tile_ranges_buffer.setData(0, nullptr, GL_STREAM_DRAW);
+    tile_ranges_texture.createBuffer(tile_ranges_buffer, GL_RG32UI);
+    tile_indices_buffer.bind(GL_TEXTURE_BUFFER);
+    tile_indices_buffer.setData(0, nullptr, GL_STREAM_DRAW);
+    tile_indices_texture.createBuffer(tile_indices_buffer, GL_R32UI);
     
-    return true;
+    // Load "default" mesh 0 used for processing
+    return loadMesh("Square.obj") != INVALID_MESH;
 }
 
 uint32_t Renderer::loadMesh(std::string const & path) {
@@ -74,10 +201,19 @@ uint32_t Renderer::loadMesh(std::string const & path) {
     if (it != meshNames.end())
         return it->second;
     Mesh mesh;
-    // TODO check for error
-    mesh.load(path);
+    
+    // Use binary cache if available, otherwise parse source and create cache
+    std::string cache = path + ".mesh";
+    if (!isUpToDate(path, cache) || !mesh.loadBinary(cache)) {
+        if (!mesh.load(path, &pool)) {
+            std::cout << "Failed to load mesh " << path << std::endl;
+            return INVALID_MESH;
+        }
+        mesh.buildIndices();
+        mesh.saveBinary(cache);
+    }
     uint32_t index = meshDatas.size();
-    meshDatas.push_back(mesh);
+    meshDatas.push_back(std::move(mesh));
     meshNames[path] = index;
     return index;
 }
@@ -86,22 +222,50 @@ uint32_t Renderer::loadImage(std::string const & path) {
     auto it = imageNames.find(path);
     if (it != imageNames.end())
         return it->second;
-    Image image;
-    // TODO check for error
-    image.load(path);
+    
+    // Decode in background, images are only needed by pack
     uint32_t index = imageDatas.size();
-    imageDatas.push_back(image);
+    imageDatas.emplace_back(new Image());
+    compressedDatas.emplace_back(new CompressedImage());
+    if (compressed) {
+        
+        // Use binary cache if available, otherwise decode and transcode source, and create cache
+        Image * image = imageDatas.back().get();
+        CompressedImage * compressed_image = compressedDatas.back().get();
+        std::string cache = path + ".bc";
+        bool valid = isUpToDate(path, cache);
+        imageLoads.push_back(pool.async<bool>([=]() {
+            if (valid && compressed_image->loadBinary(cache))
+                return true;
+            if (!image->load(path))
+                return false;
+            compressed_image->compress(*image);
+            compressed_image->saveBinary(cache);
+            return true;
+        }));
+    } else
+        imageLoads.push_back(imageDatas.back()->loadAsync(pool, path));
     imageNames[path] = index;
+    
+    // After pack, image is added to textures once decoded, and the white fallback is used meanwhile
+    if (packed) {
+        imageMaps.push_back(glm::ivec2(0, 0));
+        pendingImages.push_back(index);
+    }
     return index;
 }
 
 void Renderer::pack() {
     // TODO allow pack-less resource loading!
     
-    // Count total vertices
+    // Merge identical vertices and count total vertices and indices, including adjacency
     uint32_t count = 0;
-    for (Mesh & mesh : meshDatas)
-        count += mesh.getCount();
+    uint32_t elements = 0;
+    for (Mesh & mesh : meshDatas) {
+        mesh.buildIndices();
+        count += mesh.getIndexedCount();
+        elements += mesh.getCount();
+    }
     
     // Allocate memory
     geometry_buffer.bind(GL_ARRAY_BUFFER);
@@ -109,32 +273,121 @@ void Renderer::pack() {
     
     // Upload data
     uint32_t offset = 0;
+    uint32_t first = 0;
+    uint32_t adjacency = elements;
     meshMaps.clear();
+    meshBounds.clear();
     for (Mesh & mesh : meshDatas) {
-        geometry_buffer.setSubData(offset * 4 * 3, mesh.getCount() * 4 * 3, mesh.getPositions());
-        geometry_buffer.setSubData(count * 4 * 3 + offset * 4 * 3, mesh.getCount() * 4 * 3, mesh.getNormals());
-        geometry_buffer.setSubData(offset * 4 * 2 + count * 4 * (3 + 3), mesh.getCount() * 4 * 2, mesh.getCoordinates());
-        meshMaps.push_back({offset, mesh.getCount()});
-        offset += mesh.getCount();
+        geometry_buffer.setSubData(offset * 4 * 3, mesh.getIndexedCount() * 4 * 3, mesh.getIndexedPositions());
+        geometry_buffer.setSubData(count * 4 * 3 + offset * 4 * 3, mesh.getIndexedCount() * 4 * 3, mesh.getIndexedNormals());
+        geometry_buffer.setSubData(offset * 4 * 2 + count * 4 * (3 + 3), mesh.getIndexedCount() * 4 * 2, mesh.getIndexedCoordinates());
+        meshMaps.push_back({first, mesh.getCount(), offset, adjacency});
+        meshBounds.push_back(mesh.getBoundingSphere());
+        offset += mesh.getIndexedCount();
+        first += mesh.getCount();
+        adjacency += mesh.getCount() * 2;
     }
     
     // Configure vertex array object
     array.bind();
+    
+    // Upload indices, which are part of vertex array state
+    // Note: adjacency indices used for shadow volumes are stored after all triangle indices
+    element_buffer.bind(GL_ELEMENT_ARRAY_BUFFER);
+    element_buffer.setData(elements * 4 * 3, nullptr, GL_STATIC_DRAW);
+    for (size_t i = 0; i < meshDatas.size(); ++i) {
+        element_buffer.setSubData(meshMaps[i].x * 4, meshMaps[i].y * 4, meshDatas[i].getIndices());
+        element_buffer.setSubData(meshMaps[i].w * 4, meshMaps[i].y * 4 * 2, meshDatas[i].getAdjacencyIndices());
+    }
+    
+    // Bind vertex attributes and per-model instanced attributes
+    geometry_buffer.bind(GL_ARRAY_BUFFER);
     array.addAttribute(0, 3, GL_FLOAT, 0, 0);
     array.addAttribute(1, 3, GL_FLOAT, 0, count * 4 * 3);
     array.addAttribute(2, 2, GL_FLOAT, 0, count * 4 * (3 + 3));
-    permodel_buffer.bind(GL_ARRAY_BUFFER);
-    array.addAttributeMat4(3, 80, 0, true);
-    array.addAttribute(7, 4, GL_FLOAT, 80, 64, true);
+    permodel_buffer.reserve(1024 * sizeof(PerModel));
+    bindPerModel();
+    
+    // Wait for pending images
+    for (auto const & it : imageNames) {
+        std::future<bool> & load = imageLoads[it.second];
+        if (load.valid() && !load.get())
+            std::cout << "Failed to load image " << it.first << std::endl;
+    }
+    
+    // Group images by size, so that each size class has its own texture array and no layer is upscaled
+    // Note: class 0 is a white fallback without images, used until layers are uploaded, or if images failed to load
+    std::map<std::pair<GLuint, GLuint>, uint32_t> classes;
+    std::vector<std::vector<uint32_t>> & members = classImages;
+    members.assign(1, {});
+    imageMaps.assign(imageDatas.size(), glm::ivec2(0, 0));
+    for (GLuint index = 0; index < imageDatas.size(); ++index) {
+        std::pair<GLuint, GLuint> size;
+        if (compressed)
+            size = {compressedDatas[index]->getWidth(), compressedDatas[index]->getHeight()};
+        else
+            size = {imageDatas[index]->getWidth(), imageDatas[index]->getHeight()};
+        if (size.first == 0 || size.second == 0)
+            continue;
+        auto it = classes.find(size);
+        if (it == classes.end()) {
+            it = classes.insert({size, members.size()}).first;
+            members.emplace_back();
+        }
+        members[it->second].push_back(index);
+    }
+    
+    // Streaming relies on precomputed levels of compressed images
+    if (streaming && !compressed) {
+        std::cout << "Texture streaming requires S3TC compression, disabled" << std::endl;
+        streaming = false;
+    }
+    
+    // Uploads from a previous pack must not touch textures anymore
+    uploader.cancel();
+    
+    // Create textures, whose layers are uploaded through staging memory
+    // Note: if any image of a class has alpha, its compressed images use BC3, as array layers share the same format
+    // Note: when streaming, only low resolution levels are uploaded now
+    textures.clear();
+    pendingImages.clear();
+    Texture * fallback = new Texture();
+    textures.emplace_back(fallback);
+    GLuint white = 0xffffffff;
+    fallback->createColorArray(1, 1, 1);
+    fallback->setLayer(0, &white);
+    for (size_t c = 1; c < members.size(); ++c) {
+        std::vector<uint32_t> const & indices = members[c];
+        Texture * texture = new Texture();
+        textures.emplace_back(texture);
+        if (compressed) {
+            bool alpha = false;
+            for (uint32_t index : indices)
+                alpha = alpha || compressedDatas[index]->getFormat() != GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            for (uint32_t index : indices)
+                if (alpha)
+                    compressedDatas[index]->promote();
+            createTexture(texture, compressedDatas[indices[0]].get(), indices.size());
+        } else
+            createTexture(texture, imageDatas[indices[0]].get(), indices.size());
+        for (GLuint layer = 0; layer < indices.size(); ++layer) {
+            uint32_t index = indices[layer];
+            glm::ivec2 map(c, layer);
+            auto done = [this, index, map]() {
+                imageMaps[index] = map;
+            };
+            if (compressed)
+                uploader.upload(texture, layer, compressedDatas[index].get(), done);
+            else
+                uploader.upload(texture, layer, imageDatas[index].get(), done);
+        }
+    }
     
-    // Create textures
-    delete textures;
-    textures = new Texture();
-    std::vector<Image const *> images;
-    for (GLuint index = 0; index < imageDatas.size(); ++index)
-        images.push_back(&imageDatas[index]);
-    textures->createColorArray(images, true);
-    textures->setAnisotropy(true);
+    // When streaming, only low resolution levels are queued, which are cheap enough to be resident before first frame
+    // Note: otherwise, layers are uploaded over next frames, models using the white fallback meanwhile
+    if (streaming)
+        uploader.flush();
+    packed = true;
 }
 
 void Renderer::clear() {
@@ -150,45 +403,338 @@ void Renderer::addModel(Model const * model) {
     models.push_back(model);
 }
 
-void Renderer::prepare() {
+void Renderer::prepare(Camera const * camera) {
+    Camera const * cameras[2] = {camera, camera};
+    prepare(camera->getFrustum(), cameras);
+}
+
+void Renderer::prepare(Camera const * left, Camera const * right) {
+    Camera const * cameras[2] = {left, right};
+    prepare(Frustum::merge(left->getFrustum(), right->getFrustum()), cameras);
+}
+
+void Renderer::prepare(Frustum const & frustum, Camera const * const cameras[2]) {
+    size_t count = models.size();
     
-    // Cache per model parameters
-    permodel_data.resize(models.size());
-    for (size_t i = 0; i < models.size(); ++i) {
-        permodel_data[i].transform = models[i]->getTransform();
-        permodel_data[i].extra.x = models[i]->color;
+    // Models are processed in parallel chunks, as transforms may involve deep hierarchies
+    // Note: each job only writes its own range
+    permodel_transform.resize(count);
+    permodel_normal.resize(count * 3);
+    permodel_x.resize(count);
+    permodel_y.resize(count);
+    permodel_z.resize(count);
+    permodel_radius.resize(count);
+    permodel_visible.resize(count);
+    pool.run(count, PREPARE_CHUNK, [&](size_t begin, size_t end) {
+        
+        // Compute world bounding spheres
+        for (size_t i = begin; i < end; ++i) {
+            glm::mat4 const & transform = permodel_transform[i] = models[i]->getTransform();
+            glm::vec4 bounds = meshBounds[models[i]->mesh];
+            glm::vec4 center = transform * glm::vec4(glm::vec3(bounds), 1.0f);
+            float scale = glm::max(glm::length(glm::vec3(transform[0])), glm::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+            permodel_x[i] = center.x;
+            permodel_y[i] = center.y;
+            permodel_z[i] = center.z;
+            permodel_radius[i] = bounds.w * scale;
+        }
+        
+        // Compute normal matrices, i.e. cofactor matrices with orientation preserved
+        // Note: scale does not matter, as normals are normalized during shading
+        // Note: rotation is its own inverse transpose, hence rigid models skip the cofactors
+        for (size_t i = begin; i < end; ++i) {
+            glm::mat4 const & m = permodel_transform[i];
+            if (models[i]->rigid) {
+                for (int k = 0; k < 3; ++k)
+                    permodel_normal[i * 3 + k] = glm::vec4(glm::vec3(m[k]), 0.0f);
+                continue;
+            }
+            float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+            float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+            float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+            float c10 = m[2][1] * m[0][2] - m[2][2] * m[0][1];
+            float c11 = m[2][2] * m[0][0] - m[2][0] * m[0][2];
+            float c12 = m[2][0] * m[0][1] - m[2][1] * m[0][0];
+            float c20 = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+            float c21 = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+            float c22 = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+            float determinant = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+            float sign = determinant < 0.0f ? -1.0f : 1.0f;
+            permodel_normal[i * 3 + 0] = glm::vec4(c00 * sign, c01 * sign, c02 * sign, 0.0f);
+            permodel_normal[i * 3 + 1] = glm::vec4(c10 * sign, c11 * sign, c12 * sign, 0.0f);
+            permodel_normal[i * 3 + 2] = glm::vec4(c20 * sign, c21 * sign, c22 * sign, 0.0f);
+        }
+        
+        // Cull against view frustum
+        frustum.intersects(end - begin, permodel_x.data() + begin, permodel_y.data() + begin, permodel_z.data() + begin, permodel_radius.data() + begin, permodel_visible.data() + begin);
+    });
+    
+    // Group models by mesh and texture class, using a counting sort
+    // Note: groups of the same mesh are contiguous, so that shadow casters are still sorted by mesh
+    uint32_t classes = std::max<uint32_t>(textures.size(), 1);
+    permodel_group.resize(count);
+    pergroup_offset.assign(meshMaps.size() * classes + 1, 0);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t group = models[i]->mesh * classes + getImageMap(models[i]->color).x;
+        permodel_group[i] = group;
+        ++pergroup_offset[group + 1];
     }
+    for (size_t i = 1; i < pergroup_offset.size(); ++i)
+        pergroup_offset[i] += pergroup_offset[i - 1];
     
-    // Upload to GPU
-    // TODO use asynchronous streaming to avoid wait
-    permodel_buffer.bind(GL_ARRAY_BUFFER);
-    permodel_buffer.setData(models.size() * sizeof(PerModel), permodel_data.data(), GL_STREAM_DRAW);
+    // Get a region of the streaming buffer that is not used by pending draws
+    if (permodel_buffer.reserve(count * sizeof(PerModel))) {
+        array.bind();
+        bindPerModel();
+    }
+    PerModel * permodel_data = (PerModel *)permodel_buffer.next();
+    uint32_t permodel_first = permodel_buffer.getOffset() / sizeof(PerModel);
     
-    // Generate draw commands
-    // TODO group models that have the same mesh?
-    commands.resize(models.size());
-    for (size_t i = 0; i < models.size(); ++i) {
-        glm::ivec2 m = meshMaps[models[i]->mesh];
-        commands[i].first = m.x;
-        commands[i].count = m.y;
-        commands[i].instanceCount = 1;
-        commands[i].baseInstance = i;
+    // Assign slots so that models of the same group are contiguous
+    // Note: in each group, visible models come first, while hidden ones are kept for shadows
+    std::vector<uint32_t> front(pergroup_offset.begin(), pergroup_offset.end() - 1);
+    std::vector<uint32_t> back(pergroup_offset.begin() + 1, pergroup_offset.end());
+    perslot_model.resize(count);
+    permodel_slot.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t group = permodel_group[i];
+        uint32_t slot = permodel_visible[i] ? front[group]++ : --back[group];
+        perslot_model[slot] = i;
+        permodel_slot[i] = slot;
+    }
+    
+    // Estimate largest on-screen diameter in pixels of visible models using each texture class
+    // Note: the finer level needed by either camera is kept
+    if (streaming) {
+        glm::vec3 eyes[2] = {cameras[0]->getPosition(), cameras[1]->getPosition()};
+        float scales[2] = {height * cameras[0]->getProjection()[1][1], height * cameras[1]->getProjection()[1][1]};
+        perclass_pixels.assign(classes, 0.0f);
+        for (size_t i = 0; i < count; ++i)
+            if (permodel_visible[i]) {
+                float radius = permodel_radius[i];
+                glm::vec3 center(permodel_x[i], permodel_y[i], permodel_z[i]);
+                float & pixels = perclass_pixels[getImageMap(models[i]->color).x];
+                for (int e = 0; e < 2; ++e) {
+                    float distance = glm::max(glm::length(center - eyes[e]), radius);
+                    pixels = glm::max(pixels, radius * scales[e] / distance);
+                }
+            }
+    }
+    
+    // Write per model parameters directly to GPU memory
+    pool.run(count, PREPARE_CHUNK, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            PerModel & data = permodel_data[permodel_slot[i]];
+            data.transform = permodel_transform[i];
+            data.extra = glm::vec4(getImageMap(models[i]->color).y, 0.0f, 0.0f, 0.0f);
+            data.normal[0] = permodel_normal[i * 3 + 0];
+            data.normal[1] = permodel_normal[i * 3 + 1];
+            data.normal[2] = permodel_normal[i * 3 + 2];
+        }
+    });
+    
+    // Generate one instanced draw command per used group, with commands of each texture class being contiguous
+    commands.clear();
+    perclass_offset.assign(1, 0);
+    for (uint32_t c = 0; c < classes; ++c) {
+        for (size_t i = 0; i < meshMaps.size(); ++i) {
+            uint32_t group = i * classes + c;
+            uint32_t instances = front[group] - pergroup_offset[group];
+            if (instances == 0)
+                continue;
+            glm::ivec4 m = meshMaps[i];
+            Command command;
+            command.firstIndex = m.x;
+            command.count = m.y;
+            command.baseVertex = m.z;
+            command.instanceCount = instances;
+            command.baseInstance = permodel_first + pergroup_offset[group];
+            commands.push_back(command);
+        }
+        perclass_offset.push_back(commands.size());
+    }
+    
+    // Get sphere enclosing the near plane
+    glm::vec3 near_center = (frustum.getCorner(0) + frustum.getCorner(1) + frustum.getCorner(2) + frustum.getCorner(3)) * 0.25f;
+    float near_radius = 0.0f;
+    for (int i = 0; i < 4; ++i)
+        near_radius = glm::max(near_radius, glm::length(frustum.getCorner(i) - near_center));
+    
+    // Cached contributions are screen images, hence any camera change discards all of them at once
+    // Note: signatures are reset as well, so that contributions are only stored again once cameras stop moving
+    glm::vec3 eyes[2];
+    uint64_t signature = 0;
+    for (int i = 0; i < 2; ++i) {
+        glm::mat4 view = cameras[i]->getView();
+        glm::mat4 projection = cameras[i]->getProjection();
+        signature = hash(&view, sizeof(view), signature);
+        signature = hash(&projection, sizeof(projection), signature);
+        eyes[i] = cameras[i]->getPosition();
+    }
+    if (cached && signature != view_signature)
+        for (auto const & it : light_caches) {
+            it.second->signature = 0;
+            it.second->valid = false;
+        }
+    view_signature = signature;
+    
+    // Generate shadow casters commands and cache signature of each light, concurrently
+    light_visible.resize(lights.size());
+    light_zpass.resize(lights.size());
+    light_signature.resize(lights.size());
+    light_cache_signature.resize(lights.size());
+    perlight_commands.resize(lights.size());
+    pool.run(lights.size(), 1, [&](size_t first, size_t last) {
+        for (size_t l = first; l < last; ++l) {
+            glm::vec3 light_position = lights[l]->getPosition();
+            float light_radius = lights[l]->getRadius();
+            
+            // Lights that do not touch the view have no effect
+            light_visible[l] = frustum.intersects(light_position, light_radius);
+            light_zpass[l] = true;
+            perlight_commands[l].clear();
+            
+            // Shadow maps are cached, hence casters are selected regardless of view
+            bool mapped = lights[l]->isShadowMapped();
+            light_signature[l] = hash(&light_position, sizeof(light_position), hash(&light_radius, sizeof(light_radius)));
+            if (light_visible[l] && lights[l]->hasShadow()) {
+                for (size_t i = 0; i < meshMaps.size(); ++i) {
+                    glm::ivec4 m = meshMaps[i];
+                    Command command;
+                    command.firstIndex = mapped ? m.x : m.w;
+                    command.count = mapped ? m.y : m.y * 2;
+                    command.baseVertex = m.z;
+                    command.instanceCount = 0;
+                    for (uint32_t slot = pergroup_offset[i * classes]; slot < pergroup_offset[(i + 1) * classes]; ++slot) {
+                        uint32_t j = perslot_model[slot];
+                        bool relevant = false;
+                        if (models[j]->caster) {
+                            glm::vec3 center(permodel_x[j], permodel_y[j], permodel_z[j]);
+                            float radius = permodel_radius[j];
+                            glm::vec3 delta = center - light_position;
+                            float distance = glm::length(delta);
+                            
+                            // Caster must be in light range, and its shadow (up to light range) must be in view
+                            if (distance <= radius || (mapped && distance < light_radius + radius))
+                                relevant = true;
+                            else if (!mapped && distance < light_radius + radius) {
+                                float scale = glm::max(light_radius, distance) / distance;
+                                relevant = frustum.intersects(center, radius, light_position + delta * scale, radius * scale);
+                            }
+                            
+                            // Shadow volume is bounded by the cone from light to caster, up to extrusion length
+                            // Note: this is conservative, depth-fail is used as soon as near plane might be inside
+                            if (relevant && !mapped && light_zpass[l]) {
+                                if (distance <= radius)
+                                    light_zpass[l] = false;
+                                else {
+                                    glm::vec3 direction = delta / distance;
+                                    float end = distance + radius + EXTRUSION_SCALE * light_radius;
+                                    float spread = glm::max(radius, end * radius / glm::sqrt(distance * distance - radius * radius));
+                                    if (getDistance(near_center, light_position + direction * (distance - radius), light_position + direction * end) < near_radius + spread)
+                                        light_zpass[l] = false;
+                                }
+                            }
+                        }
+                        
+                        // Combine casters regardless of order, as it depends on view
+                        if (relevant && mapped) {
+                            Model const * model = models[j];
+                            light_signature[l] += hash(&model, sizeof(model), hash(&permodel_transform[j], sizeof(glm::mat4), i));
+                        }
+                        
+                        // Merge consecutive instances in a single command
+                        if (relevant) {
+                            if (command.instanceCount == 0)
+                                command.baseInstance = permodel_first + slot;
+                            ++command.instanceCount;
+                        } else if (command.instanceCount > 0) {
+                            perlight_commands[l].push_back(command);
+                            command.instanceCount = 0;
+                        }
+                    }
+                    if (command.instanceCount > 0)
+                        perlight_commands[l].push_back(command);
+                }
+            }
+            
+            // Only visible lights are shaded, hence cached
+            if (cached && light_visible[l])
+                light_cache_signature[l] = getLightSignature(lights[l], eyes);
+        }
+    });
+    
+    // Store commands contiguously
+    light_offset.assign(1, 0);
+    light_commands.clear();
+    for (size_t l = 0; l < lights.size(); ++l) {
+        light_commands.insert(light_commands.end(), perlight_commands[l].begin(), perlight_commands[l].end());
+        light_offset.push_back(light_commands.size());
+    }
+    
+    // Release shadow maps and cached contributions of removed lights
+    for (auto it = shadow_maps.begin(); it != shadow_maps.end();) {
+        if (std::find(lights.begin(), lights.end(), it->first) == lights.end())
+            it = shadow_maps.erase(it);
+        else
+            ++it;
+    }
+    for (auto it = light_caches.begin(); it != light_caches.end();) {
+        if (std::find(lights.begin(), lights.end(), it->first.first) == lights.end())
+            it = light_caches.erase(it);
+        else
+            ++it;
     }
 }
 
 void Renderer::render(Camera const * camera) {
+    assert(!stereo);
+    Camera const * cameras[2] = {camera, camera};
+    render(cameras);
+}
+
+void Renderer::render(Camera const * left, Camera const * right) {
+    assert(stereo);
+    Camera const * cameras[2] = {left, right};
+    render(cameras);
+}
+
+void Renderer::render(Camera const * const cameras[2]) {
+    profiler.beginFrame();
     
-    // Use the same vertex array and texture array for everything
+    // Use the same vertex array for everything
     array.bind();
-    textures->bind(4);
+    
+    // Issue texture uploads and adjust resolution of streamed textures before they are sampled
+    profiler.beginSection("uploads");
+    loadImages();
+    uploader.update();
+    streamTextures();
+    profiler.endSection();
+    
+    // Update outdated shadow maps first, as they use their own framebuffer
+    profiler.beginSection("shadow maps");
+    renderShadowMaps(cameras);
+    profiler.endSection();
+    
+    // In stereo, viewport 0 covers the whole target, while eyes use viewports 1 and 2
+    if (stereo) {
+        glViewport(0, 0, width * 2, height);
+        glViewportIndexedf(1, 0.0f, 0.0f, width, height);
+        glViewportIndexedf(2, width, 0.0f, width, height);
+    }
     
     // Bind textures
     render_color.bind(0);
-    render_position.bind(1);
+    if (compact)
+        render_depth.bind(1);
+    else
+        render_position.bind(1);
     render_normal.bind(2);
     render_light.bind(3);
     
     // Select complete render framebuffer
+    profiler.beginSection("geometry");
     render_framebuffer.bind();
     
     // Clear everything
@@ -200,12 +746,24 @@ void Renderer::render(Camera const * camera) {
     
     // Select render shader
     render_shader.use();
-    render_shader.setUniform("projection", camera->getProjection());
-    render_shader.setUniform("view", camera->getView());
+    setCameras(render_shader, cameras);
     render_shader.setUniform("textures", 4);
     
     // Draw textured geometry and store diffuse, emissive, position and normals
-    glMultiDrawArraysIndirect(GL_TRIANGLES, commands.data(), commands.size(), 0);
+    // Note: each texture class is drawn separately, as it uses its own array
+    for (size_t c = 0; c < textures.size(); ++c) {
+        uint32_t first = perclass_offset[c];
+        uint32_t count = perclass_offset[c + 1] - first;
+        if (count == 0)
+            continue;
+        textures[c]->bind(4);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, commands.data() + first, count, 0);
+    }
+    
+    // In compact mode, copy depth, so that positions are not reconstructed from an attached texture
+    if (compact)
+        glCopyImageSubData(render_depthStencil.getHandle(), GL_TEXTURE_2D, 0, 0, 0, 0, render_depth.getHandle(), GL_TEXTURE_2D, 0, 0, 0, 0, render_depth.getWidth(), render_depth.getHeight(), 1);
+    profiler.endSection();
     
     // Select light-only render buffer
     render_light_framebuffer.bind();
@@ -219,46 +777,120 @@ void Renderer::render(Camera const * camera) {
     // Disable depth test
     glDisable(GL_DEPTH_TEST);
     
+    // Only touch pixels that may be lit
+    glEnable(GL_SCISSOR_TEST);
+    
     // For each light...
-    for (Light const * light : lights) {
+    for (size_t l = 0; l < lights.size(); ++l) {
+        Light const * light = lights[l];
+        if (!light_visible[l] || (tiled && !light->hasShadow()))
+            continue;
+        
+        // Restrict stencil, shadow volumes and shading to the screen area covered by light range
+        glm::ivec4 scissor = getScissor(cameras, light->getPosition(), light->getRadius());
+        if (scissor.z <= 0 || scissor.w <= 0)
+            continue;
+        glScissor(scissor.x, scissor.y, scissor.z, scissor.w);
+        std::string name = profiler.isEnabled() ? "light " + std::to_string(l) : std::string();
+        
+        // Reuse previous contribution if nothing changed
+        bool caching = false;
+        LightCache * cache = nullptr;
+        if (cached) {
+            uint64_t signature = light_cache_signature[l];
+            std::unique_ptr<LightCache> & entry = light_caches[std::make_pair(light, cameras[0])];
+            if (!entry) {
+                entry.reset(new LightCache());
+                entry->signature = ~signature;
+                entry->allocated = false;
+                entry->valid = false;
+            }
+            cache = entry.get();
+            if (cache->valid && cache->signature == signature) {
+                profiler.beginSection(name + " cached");
+                glStencilFuncSeparate(GL_FRONT_AND_BACK, GL_ALWAYS, 0, ~(GLint)0);
+                blendLight(cache->texture);
+                profiler.endSection();
+                continue;
+            }
+            
+            // Otherwise, store contribution if light was already unchanged in previous frame
+            if (cache->signature == signature && !cache->allocated) {
+                size_t allocated = 0;
+                for (auto const & it : light_caches)
+                    if (it.second->allocated)
+                        ++allocated;
+                if (allocated < LIGHT_CACHE_SIZE) {
+                    cache->texture.createColor(stereo ? width * 2 : width, height, true);
+                    cache->framebuffer.bind();
+                    cache->framebuffer.attach(cache->texture);
+                    cache->framebuffer.attach(render_depthStencil);
+                    cache->framebuffer.validate();
+                    cache->allocated = true;
+                }
+            }
+            caching = cache->signature == signature && cache->allocated;
+            cache->signature = signature;
+            cache->valid = false;
+            if (caching) {
+                cache->framebuffer.bind();
+                glClear(GL_COLOR_BUFFER_BIT);
+            } else
+                render_light_framebuffer.bind();
+        }
 
-        // Clear stencil
-        glClear(GL_STENCIL_BUFFER_BIT);
+        // Shadow mapped lights do not need stencil
+        // Note: their casters commands are not suited for extrusion, hence a missing map only disables shadow
+        bool mapped = light->isShadowMapped();
+        auto map = shadow_maps.find(light);
+        bool sampled = mapped && light->hasShadow() && map != shadow_maps.end();
+        if (!mapped) {
+            profiler.beginSection(name + " extrusion");
+            
+            // Clear stencil
+            glClear(GL_STENCIL_BUFFER_BIT);
 
-        // Use Carmack's reverse shadow volume strategy
-        glStencilFuncSeparate(GL_FRONT_AND_BACK, GL_ALWAYS, 0, ~(GLint)0);
-        glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
-        glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+            // Use depth-pass when possible, otherwise use Carmack's reverse shadow volume strategy
+            glStencilFuncSeparate(GL_FRONT_AND_BACK, GL_ALWAYS, 0, ~(GLint)0);
+            if (light_zpass[l]) {
+                glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_KEEP, GL_INCR_WRAP);
+                glStencilOpSeparate(GL_BACK, GL_KEEP, GL_KEEP, GL_DECR_WRAP);
+            } else {
+                glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+                glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+            }
 
-        // Do not write color as well
-        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            // Do not write color as well
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
         
-        // Enable depth test
-        glEnable(GL_DEPTH_TEST);
+            // Enable depth test
+            glEnable(GL_DEPTH_TEST);
         
-        // Select extrusion shader
-        extrusion_shader.use();
-        extrusion_shader.setUniform("projection", camera->getProjection());
-        extrusion_shader.setUniform("view", camera->getView());
-        extrusion_shader.setUniform("light_position", light->getPosition());
-        extrusion_shader.setUniform("light_radius", light->getRadius());
-
-        // TODO depth clamp?
-        // see https://www.opengl.org/wiki_132/index.php?title=Vertex_Post-Processing&redirect=no#Depth_clamping
-
-        // Draw geometry
-        // TODO consider only relevant objects (i.e. filter CPU-side)
-        // TODO filter non-caster objects
-        glMultiDrawArraysIndirect(GL_TRIANGLES, commands.data(), commands.size(), 0);
-
-        // Now, write color
-        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            // Select extrusion shader
+            extrusion_shader.use();
+            setCameras(extrusion_shader, cameras);
+            extrusion_shader.setUniform("light_position", light->getPosition());
+            extrusion_shader.setUniform("light_extrusion", light->getRadius() * EXTRUSION_SCALE);
+            extrusion_shader.setUniform("caps", light_zpass[l] ? 0 : 1);
+
+            // Clamp depth, so that far caps are not clipped
+            glEnable(GL_DEPTH_CLAMP);
+
+            // Draw relevant shadow casters, with adjacency to extrude silhouettes only
+            glMultiDrawElementsIndirect(GL_TRIANGLES_ADJACENCY, GL_UNSIGNED_INT, light_commands.data() + light_offset[l], light_offset[l + 1] - light_offset[l], 0);
+            glDisable(GL_DEPTH_CLAMP);
+
+            // Now, write color
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
         
-        // Disable depth test
-        glDisable(GL_DEPTH_TEST);
+            // Disable depth test
+            glDisable(GL_DEPTH_TEST);
+            profiler.endSection();
+        }
 
         // Use stencil to only draw on non-zero area
-        glStencilFuncSeparate(GL_FRONT_AND_BACK, GL_EQUAL, 0, ~(GLint)0);
+        profiler.beginSection(name + " shading");
+        glStencilFuncSeparate(GL_FRONT_AND_BACK, mapped ? GL_ALWAYS : GL_EQUAL, 0, ~(GLint)0);
         glStencilOpSeparate(GL_FRONT_AND_BACK, GL_KEEP, GL_KEEP, GL_KEEP);
         
         // Use additive blend to combine lightmaps
@@ -273,18 +905,61 @@ void Renderer::render(Camera const * camera) {
         shading_shader.setUniform("light_color", light->getColor());
         shading_shader.setUniform("light_radius", light->getRadius());
         shading_shader.setUniform("texture_position", 1);
+        shading_shader.setUniform("texture_depth", 1);
+        setCameras(shading_shader, cameras);
         shading_shader.setUniform("texture_normal", 2);
+        shading_shader.setUniform("shadow_mapped", sampled ? 1 : 0);
+        shading_shader.setUniform("shadow_map", 8);
+        shading_shader.setUniform("shadow_near", light->getRadius() * SHADOW_NEAR);
+        if (sampled)
+            map->second->texture.bind(8);
 
-        // Draw geometry again to shade surfaces properly
-        // TODO maybe should not draw full-screen quad and only cover expected area (e.g. using a sphere)
-        glDrawArrays(GL_TRIANGLES, meshMaps[0].x, meshMaps[0].y);
+        // Draw full-screen quad, which is clipped by scissor test
+        drawMesh(0);
 
         // Restore default values
         glDisable(GL_BLEND);
+        
+        // Add stored contribution to the actual light buffer
+        if (caching) {
+            render_light_framebuffer.bind();
+            glStencilFuncSeparate(GL_FRONT_AND_BACK, GL_ALWAYS, 0, ~(GLint)0);
+            blendLight(cache->texture);
+            cache->valid = true;
+        }
+        profiler.endSection();
     }
     
     // Restore defaults
+    glDisable(GL_SCISSOR_TEST);
     glDisable(GL_STENCIL_TEST);
+    
+    // Shade all lights without shadow at once
+    if (tiled) {
+        prepareTiles(cameras);
+        if (!tile_indices.empty()) {
+            profiler.beginSection("tiled");
+            glEnable(GL_BLEND);
+            glBlendEquation(GL_FUNC_ADD);
+            glBlendFunc(GL_ONE, GL_ONE);
+            tile_lights_texture.bind(5);
+            tile_ranges_texture.bind(6);
+            tile_indices_texture.bind(7);
+            tiled_shader.use();
+            tiled_shader.setUniform("tile_size", (GLint)TILE_SIZE);
+            tiled_shader.setUniform("tile_columns", (GLint)tile_columns);
+            tiled_shader.setUniform("texture_position", 1);
+            tiled_shader.setUniform("texture_depth", 1);
+            setCameras(tiled_shader, cameras);
+            tiled_shader.setUniform("texture_normal", 2);
+            tiled_shader.setUniform("light_data", 5);
+            tiled_shader.setUniform("tile_data", 6);
+            tiled_shader.setUniform("index_data", 7);
+            drawMesh(0);
+            glDisable(GL_BLEND);
+            profiler.endSection();
+        }
+    }
     glDepthMask(GL_TRUE);
     
     /*
@@ -296,30 +971,454 @@ void Renderer::render(Camera const * camera) {
     finalize_shader.setUniform("texture_position", 1);
     finalize_shader.setUniform("texture_normal", 2);
     finalize_shader.setUniform("texture_light", 3);
-    glDrawArrays(GL_TRIANGLES, meshMaps[0].x, meshMaps[0].y);
+    drawMesh(0);
 
     // Apply FXAA
-    if (camera->getFramebuffer())
-        camera->getFramebuffer()->bind();
+    if (cameras[0]->getFramebuffer())
+        cameras[0]->getFramebuffer()->bind();
     else
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     processing_color[0].bind(0);
     antialiasing_shader.use();
     antialiasing_shader.setUniform("texture", 0);
-    glDrawArrays(GL_TRIANGLES, meshMaps[0].x, meshMaps[0].y);
+    drawMesh(0);
     */
     
     // Combine result on screen
     // TODO bloom, hdr, tone mapping, gamma correction
-    if (camera->getFramebuffer())
-        camera->getFramebuffer()->bind();
-    else
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    profiler.beginSection("finalize");
     finalize_shader.use();
     finalize_shader.setUniform("texture_color", 0);
     finalize_shader.setUniform("texture_position", 1);
     finalize_shader.setUniform("texture_normal", 2);
     finalize_shader.setUniform("texture_light", 3);
-    glDrawArrays(GL_TRIANGLES, meshMaps[0].x, meshMaps[0].y);
+    if (!stereo) {
+        if (cameras[0]->getFramebuffer())
+            cameras[0]->getFramebuffer()->bind();
+        else
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        drawMesh(0);
+    } else {
+        
+        // Each eye framebuffer only receives its half, using an offset viewport
+        // Note: eyes without framebuffer are shown side-by-side on screen
+        for (int i = 0; i < 2; ++i) {
+            if (cameras[i]->getFramebuffer()) {
+                cameras[i]->getFramebuffer()->bind();
+                glViewport(-i * (GLint)width, 0, width * 2, height);
+            } else if (i == 0 || cameras[0]->getFramebuffer()) {
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                glViewport(0, 0, width * 2, height);
+            } else
+                continue;
+            drawMesh(0);
+        }
+    }
+    profiler.endSection();
+    
+}
+
+void Renderer::setCameras(Shader & shader, Camera const * const cameras[2]) {
+    if (stereo) {
+        for (int i = 0; i < 2; ++i) {
+            std::string index = i ? "[1]" : "[0]";
+            shader.setUniform("projection" + index, cameras[i]->getProjection());
+            shader.setUniform("view" + index, cameras[i]->getView());
+            shader.setUniform("inverse_view_projection" + index, glm::inverse(cameras[i]->getProjection() * cameras[i]->getView()));
+        }
+    } else {
+        shader.setUniform("projection", cameras[0]->getProjection());
+        shader.setUniform("view", cameras[0]->getView());
+        shader.setUniform("inverse_view_projection", glm::inverse(cameras[0]->getProjection() * cameras[0]->getView()));
+    }
+}
+
+size_t Renderer::getWorkerCount() const {
+    return pool.getWorkerCount();
+}
+
+void Renderer::setWorkerCount(size_t workers) {
+    pool.setWorkerCount(workers);
+}
+
+Profiler * Renderer::getProfiler() {
+    return &profiler;
+}
+
+void Renderer::createTexture(Texture * texture, Image const * image, GLuint depth) {
+    texture->createColorArray(image->getWidth(), image->getHeight(), depth, true);
+    texture->setAnisotropy(true);
+}
+
+void Renderer::createTexture(Texture * texture, CompressedImage const * image, GLuint depth) {
+    GLuint base = streaming ? getStreamingLevel(image->getWidth(), image->getHeight()) : 0;
+    texture->createCompressedArray(image->getWidth(), image->getHeight(), depth, image->getFormat(), image->getLevelCount(), base);
+    texture->setAnisotropy(true);
+}
+
+glm::ivec2 Renderer::getImageMap(uint32_t image) const {
+    return image < imageMaps.size() ? imageMaps[image] : glm::ivec2(0, 0);
+}
+
+void Renderer::loadImages() {
+    for (auto it = pendingImages.begin(); it != pendingImages.end();) {
+        uint32_t index = *it;
+        std::future<bool> & load = imageLoads[index];
+        if (load.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+        it = pendingImages.erase(it);
+        if (!load.get()) {
+            for (auto const & name : imageNames)
+                if (name.second == index)
+                    std::cout << "Failed to load image " << name.first << std::endl;
+            continue;
+        }
+        
+        // Find a class with the same size, and a compatible format if compressed
+        // Note: white fallback is never shared
+        Image const * image = imageDatas[index].get();
+        CompressedImage * compressed_image = compressedDatas[index].get();
+        size_t c = 1;
+        for (; c < textures.size(); ++c) {
+            uint32_t other = classImages[c][0];
+            if (compressed) {
+                CompressedImage const * other_image = compressedDatas[other].get();
+                if (other_image->getWidth() != compressed_image->getWidth() || other_image->getHeight() != compressed_image->getHeight())
+                    continue;
+                if (other_image->getFormat() != compressed_image->getFormat() && other_image->getFormat() == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+                    continue;
+                compressed_image->promote();
+                break;
+            }
+            if (imageDatas[other]->getWidth() == image->getWidth() && imageDatas[other]->getHeight() == image->getHeight())
+                break;
+        }
+        
+        // Append a layer, copying existing ones on GPU, or create a new class
+        Texture * texture;
+        if (c < textures.size()) {
+            texture = textures[c].get();
+            texture->setDepth(texture->getDepth() + 1);
+        } else {
+            texture = new Texture();
+            textures.emplace_back(texture);
+            classImages.emplace_back();
+            if (compressed)
+                createTexture(texture, compressed_image, 1);
+            else
+                createTexture(texture, image, 1);
+        }
+        glm::ivec2 map(c, classImages[c].size());
+        classImages[c].push_back(index);
+        
+        // Models keep using the white fallback until the new layer is uploaded
+        auto done = [this, index, map]() {
+            imageMaps[index] = map;
+        };
+        if (compressed)
+            uploader.upload(texture, map.y, compressed_image, done);
+        else
+            uploader.upload(texture, map.y, image, done);
+    }
+}
+
+bool Renderer::isStreaming() const {
+    return streaming;
+}
+
+void Renderer::setStreaming(bool streaming) {
+    this->streaming = streaming;
+}
+
+void Renderer::streamTextures() {
+    if (!streaming || !compressed || perclass_pixels.size() != textures.size())
+        return;
+    char * data = nullptr;
+    GLuint used = 0;
+    for (size_t c = 1; c < textures.size(); ++c) {
+        Texture * texture = textures[c].get();
+        std::vector<uint32_t> const & indices = classImages[c];
+        CompressedImage const * image = compressedDatas[indices[0]].get();
+        
+        // Select level with roughly one texel per pixel, assuming texture covers model once
+        // Note: classes that are not visible go back to their startup resolution
+        GLuint initial = getStreamingLevel(image->getWidth(), image->getHeight());
+        GLuint desired = initial;
+        if (perclass_pixels[c] > 0.0f) {
+            float ratio = std::max(image->getWidth(), image->getHeight()) / perclass_pixels[c];
+            desired = ratio > 1.0f ? std::min((GLuint)std::log2(ratio), initial) : 0;
+        }
+        
+        // Release finest level if much more detailed than needed
+        GLuint base = texture->getBaseLevel();
+        if (desired > base + 1) {
+            texture->setBaseLevel(base + 1);
+            continue;
+        }
+        if (desired >= base)
+            continue;
+        
+        // Otherwise, upload next finer level through streaming buffer, one level per class and frame
+        GLuint level = base - 1;
+        GLuint size = image->getLevelSize(level);
+        if (used > 0 && used + size * indices.size() > STREAMING_BUDGET)
+            continue;
+        if (!data) {
+            streaming_buffer.reserve(std::max<GLuint>(STREAMING_BUDGET, size * indices.size()));
+            data = (char *)streaming_buffer.next();
+        }
+        texture->setBaseLevel(level);
+        streaming_buffer.getBuffer()->bind(GL_PIXEL_UNPACK_BUFFER);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            memcpy(data + used, compressedDatas[indices[i]]->getLevelPointer(level), size);
+            texture->setCompressedLayer(i, level, size, (void *)(intptr_t)(streaming_buffer.getOffset() + used));
+            used += size;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+}
+
+bool Renderer::isCached() const {
+    return cached;
+}
+
+void Renderer::setCached(bool cached) {
+    this->cached = cached;
+    if (!cached)
+        light_caches.clear();
+}
+
+bool Renderer::isTiled() const {
+    return tiled;
+}
+
+void Renderer::setTiled(bool tiled) {
+    this->tiled = tiled;
+}
+
+void Renderer::prepareTiles(Camera const * const cameras[2]) {
+    
+    // Collect lights and their screen area, once per eye in stereo
+    tile_lights.clear();
+    tile_ranges.assign(tile_columns * tile_rows, glm::uvec2(0, 0));
+    std::vector<glm::uvec4> areas;
+    std::vector<GLuint> area_lights;
+    for (size_t l = 0; l < lights.size(); ++l) {
+        Light const * light = lights[l];
+        if (!light_visible[l] || light->hasShadow())
+            continue;
+        GLuint index = tile_lights.size() / 2;
+        for (GLuint eye = 0; eye < (stereo ? 2u : 1u); ++eye) {
+            glm::ivec4 scissor = getScissor(cameras[eye], light->getPosition(), light->getRadius());
+            if (scissor.z <= 0 || scissor.w <= 0)
+                continue;
+            scissor.x += eye * width;
+            glm::uvec4 area(scissor.x / TILE_SIZE, scissor.y / TILE_SIZE, (scissor.x + scissor.z - 1) / TILE_SIZE, (scissor.y + scissor.w - 1) / TILE_SIZE);
+            area.z = glm::min(area.z, tile_columns - 1);
+            area.w = glm::min(area.w, tile_rows - 1);
+            areas.push_back(area);
+            area_lights.push_back(index);
+            for (GLuint y = area.y; y <= area.w; ++y)
+                for (GLuint x = area.x; x <= area.z; ++x)
+                    ++tile_ranges[y * tile_columns + x].y;
+        }
+        if (!area_lights.empty() && area_lights.back() == index) {
+            tile_lights.push_back(glm::vec4(light->getPosition(), light->getRadius()));
+            tile_lights.push_back(glm::vec4(light->getColor(), 0.0f));
+        }
+    }
+    
+    // Bin lights using a counting sort
+    GLuint offset = 0;
+    for (glm::uvec2 & range : tile_ranges) {
+        range.x = offset;
+        offset += range.y;
+        range.y = 0;
+    }
+    tile_indices.resize(offset);
+    for (GLuint i = 0; i < areas.size(); ++i)
+        for (GLuint y = areas[i].y; y <= areas[i].w; ++y)
+            for (GLuint x = areas[i].x; x <= areas[i].z; ++x) {
+                glm::uvec2 & range = tile_ranges[y * tile_columns + x];
+                tile_indices[range.x + range.y++] = area_lights[i];
+            }
+    
+    // Upload to GPU
+    if (!tile_indices.empty()) {
+        tile_lights_buffer.bind(GL_TEXTURE_BUFFER);
+        tile_lights_buffer.setData(tile_lights.size() * sizeof(glm::vec4), tile_lights.data(), GL_STREAM_DRAW);
+        tile_ranges_buffer.bind(GL_TEXTURE_BUFFER);
+        tile_ranges_buffer.setData(tile_ranges.size() * sizeof(glm::uvec2), tile_ranges.data(), GL_STREAM_DRAW);
+        tile_indices_buffer.bind(GL_TEXTURE_BUFFER);
+        tile_indices_buffer.setData(tile_indices.size() * sizeof(GLuint), tile_indices.data(), GL_STREAM_DRAW);
+    }
+}
+
+void Renderer::renderShadowMaps(Camera const * const cameras[2]) {
+    bool selected = false;
+    for (size_t l = 0; l < lights.size(); ++l) {
+        Light const * light = lights[l];
+        if (!light_visible[l] || !light->hasShadow() || !light->isShadowMapped())
+            continue;
+        
+        // Any eye may see the light, as in shading
+        glm::ivec4 scissor = getScissor(cameras, light->getPosition(), light->getRadius());
+        if (scissor.z <= 0 || scissor.w <= 0)
+            continue;
+        
+        // Choose resolution according to screen coverage, so that a texel roughly matches a pixel
+        // Note: in stereo, the largest coverage of a single eye is used
+        GLint extent = glm::max(scissor.z, scissor.w);
+        if (stereo) {
+            extent = 0;
+            for (int i = 0; i < 2; ++i) {
+                glm::ivec4 eye = getScissor(cameras[i], light->getPosition(), light->getRadius());
+                extent = glm::max(extent, glm::max(eye.z, eye.w));
+            }
+        }
+        GLuint size = SHADOW_MIN_SIZE;
+        while (size < SHADOW_MAX_SIZE && size * 2 < (GLuint)extent)
+            size *= 2;
+        
+        // Keep existing map if up-to-date and not too far from expected resolution
+        std::unique_ptr<ShadowMap> & map = shadow_maps[light];
+        if (map && map->signature == light_signature[l] && map->texture.getWidth() * 2 >= size && map->texture.getWidth() <= size * 2)
+            continue;
+        if (!map || map->texture.getWidth() != size) {
+            map.reset(new ShadowMap());
+            map->texture.createDepthCube(size);
+        }
+        map->signature = light_signature[l];
+        
+        // Configure state once for all maps
+        if (!selected) {
+            selected = true;
+            shadow_framebuffer.bind();
+            shadow_shader.use();
+            glEnable(GL_DEPTH_TEST);
+            glEnable(GL_POLYGON_OFFSET_FILL);
+            glPolygonOffset(1.5f, 4.0f);
+        }
+        glViewport(0, 0, size, size);
+        
+        // Render each face with a 90 degrees field of view
+        glm::vec3 position = light->getPosition();
+        float radius = light->getRadius();
+        glm::mat4 projection = glm::perspective(PI / 2.0f, 1.0f, radius * SHADOW_NEAR, radius);
+        for (GLuint face = 0; face < 6; ++face) {
+            shadow_framebuffer.attach(map->texture, face);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            glm::mat4 view = glm::lookAt(position, position + SHADOW_FACES[face][0], SHADOW_FACES[face][1]);
+            shadow_shader.setUniform("view_projection", projection * view);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, light_commands.data() + light_offset[l], light_offset[l + 1] - light_offset[l], 0);
+        }
+    }
+    
+    // Restore defaults
+    if (selected) {
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glDisable(GL_DEPTH_TEST);
+        glViewport(0, 0, width, height);
+    }
+}
+
+uint64_t Renderer::getLightSignature(Light const * light, glm::vec3 const eyes[2]) const {
+    glm::vec3 position = light->getPosition();
+    float radius = light->getRadius();
+    glm::vec3 color = light->getColor();
+    bool shadow = light->hasShadow();
+    uint64_t signature = hash(&position, sizeof(position));
+    signature = hash(&radius, sizeof(radius), signature);
+    signature = hash(&color, sizeof(color), signature);
+    signature = hash(&shadow, sizeof(shadow), signature);
+    
+    // Any model in light range or between camera and light range may change the result
+    // Note: models are combined regardless of order
+    for (size_t i = 0; i < models.size(); ++i) {
+        glm::vec3 center(permodel_x[i], permodel_y[i], permodel_z[i]);
+        float distance = glm::min(getDistance(center, eyes[0], position), getDistance(center, eyes[1], position));
+        if (distance < radius + permodel_radius[i]) {
+            Model const * model = models[i];
+            uint64_t h = hash(&model, sizeof(model), hash(&permodel_transform[i], sizeof(glm::mat4)));
+            h = hash(&model->mesh, sizeof(model->mesh), h);
+            h = hash(&model->caster, sizeof(model->caster), h);
+            signature += h;
+        }
+    }
+    return signature;
+}
+
+void Renderer::blendLight(Texture & texture) {
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_FUNC_ADD);
+    glBlendFunc(GL_ONE, GL_ONE);
+    texture.bind(9);
+    copy_shader.use();
+    copy_shader.setUniform("texture", 9);
+    drawMesh(0);
+    glDisable(GL_BLEND);
+}
+
+void Renderer::bindPerModel() {
+    permodel_buffer.getBuffer()->bind(GL_ARRAY_BUFFER);
+    array.addAttributeMat4(3, sizeof(PerModel), 0, true);
+    array.addAttribute(7, 4, GL_FLOAT, sizeof(PerModel), 64, true);
+    array.addAttribute(8, 3, GL_FLOAT, sizeof(PerModel), 80, true);
+    array.addAttribute(9, 3, GL_FLOAT, sizeof(PerModel), 96, true);
+    array.addAttribute(10, 3, GL_FLOAT, sizeof(PerModel), 112, true);
+}
+
+void Renderer::drawMesh(uint32_t mesh) {
+    glm::ivec4 m = meshMaps[mesh];
+    glDrawElementsBaseVertex(GL_TRIANGLES, m.y, GL_UNSIGNED_INT, (void *)(intptr_t)(m.x * 4), m.z);
+}
+
+glm::ivec4 Renderer::getScissor(Camera const * const cameras[2], glm::vec3 const & center, float radius) const {
+    glm::ivec4 scissor = getScissor(cameras[0], center, radius);
+    if (!stereo)
+        return scissor;
+    
+    // Right eye is on the right half, and both areas are merged
+    glm::ivec4 right = getScissor(cameras[1], center, radius);
+    if (right.z <= 0 || right.w <= 0)
+        return scissor;
+    right.x += width;
+    if (scissor.z <= 0 || scissor.w <= 0)
+        return right;
+    GLint x0 = glm::min(scissor.x, right.x);
+    GLint y0 = glm::min(scissor.y, right.y);
+    GLint x1 = glm::max(scissor.x + scissor.z, right.x + right.z);
+    GLint y1 = glm::max(scissor.y + scissor.w, right.y + right.w);
+    return glm::ivec4(x0, y0, x1 - x0, y1 - y0);
+}
+
+glm::ivec4 Renderer::getScissor(Camera const * camera, glm::vec3 const & center, float radius) const {
+    
+    // Project bounding box of the sphere, in view space
+    glm::mat4 projection = camera->getProjection();
+    glm::vec3 c = glm::vec3(camera->getView() * glm::vec4(center, 1.0f));
+    glm::vec2 low(1.0f, 1.0f);
+    glm::vec2 high(-1.0f, -1.0f);
+    for (int i = 0; i < 8; ++i) {
+        glm::vec3 corner = c + radius * glm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+        glm::vec4 p = projection * glm::vec4(corner, 1.0f);
+        
+        // Box crosses camera plane, assume whole screen is affected
+        if (p.w <= 0.0f)
+            return glm::ivec4(0, 0, width, height);
+        glm::vec2 q = glm::vec2(p.x, p.y) / p.w;
+        low = glm::min(low, q);
+        high = glm::max(high, q);
+    }
     
+    // Convert to pixels
+    low = glm::clamp(low * 0.5f + 0.5f, 0.0f, 1.0f);
+    high = glm::clamp(high * 0.5f + 0.5f, 0.0f, 1.0f);
+    GLint x0 = (GLint)glm::floor(low.x * width);
+    GLint y0 = (GLint)glm::floor(low.y * height);
+    GLint x1 = (GLint)glm::ceil(high.x * width);
+    GLint y1 = (GLint)glm::ceil(high.y * height);
+    return glm::ivec4(x0, y0, x1 - x0, y1 - y0);
 }
@@ -4,7 +4,9 @@
 
 #include "Common.hpp"
 #include "Buffer.hpp"
+#include "RingBuffer.hpp"
 #include "Image.hpp"
+#include "CompressedImage.hpp"
 #include "Mesh.hpp"
 #include "Texture.hpp"
 #include "VertexArray.hpp"
@@ -15,6 +17,9 @@
 #include "Model.hpp"
 #include "Light.hpp"
 #include "Material.hpp"
+#include "ThreadPool.hpp"
+#include "Profiler.hpp"
+#include "Uploader.hpp"
 
 class Renderer {
 public:
@@ -25,23 +30,78 @@ public:
     Renderer(Renderer const &) = delete;
     Renderer & operator=(Renderer const &) = delete;
     
-    bool initialize(uint32_t width, uint32_t height);
+    // Note: compact mode reconstructs positions from depth and stores normals in two channels
+    // Note: stereo mode renders both eyes side-by-side in a single pass, with the given size per eye
+    bool initialize(uint32_t width, uint32_t height, bool compact = false, bool stereo = false);
     
+    // Note: returns INVALID_MESH on failure, and nothing is added to geometry
+    static uint32_t const INVALID_MESH = 0xffffffff;
     uint32_t loadMesh(std::string const & path);
+    
+    // Note: images loaded after pack are added to textures once decoded and uploaded
+    // Note: models without image (i.e. NO_IMAGE, failed or not yet uploaded) use a white texture
+    static uint32_t const NO_IMAGE = 0xffffffff;
     uint32_t loadImage(std::string const & path);
     void pack();
     
     void clear();
     void addLight(Light const * light);
     void addModel(Model const * model);
-    void prepare();
+    
+    // Note: culling is done once for all cameras (e.g. both eyes)
+    void prepare(Camera const * camera);
+    void prepare(Camera const * left, Camera const * right);
+    
+    // Workers used to process models in prepare, in addition to the calling thread
+    // Note: model transforms must be safe to compute concurrently during prepare
+    size_t getWorkerCount() const;
+    void setWorkerCount(size_t workers);
     
     void render(Camera const * camera);
+    void render(Camera const * left, Camera const * right); // Note: only in stereo mode
+    
+    // GPU time of each pass in render, including extrusion and shading of each light
+    Profiler * getProfiler();
+    
+    // Shade all lights without shadow in a single pass, using screen tiles
+    bool isTiled() const;
+    void setTiled(bool tiled);
+    
+    // Upload finer levels of compressed textures progressively, according to their on-screen size
+    // Note: must be set before pack, only low resolution levels are then resident at startup
+    // Note: without streaming, pack does not wait for textures, which are used once uploaded
+    // Note: requires S3TC compression, otherwise pack disables it
+    bool isStreaming() const;
+    void setStreaming(bool streaming);
+    
+    // Reuse light contribution of previous frames, if light, camera and nearby models did not move
+    // Note: disabled by default, as any camera motion invalidates contributions
+    bool isCached() const;
+    void setCached(bool cached);
     
 private:
     
+    void prepare(Frustum const & frustum, Camera const * const cameras[2]);
+    void render(Camera const * const cameras[2]);
+    void setCameras(Shader & shader, Camera const * const cameras[2]);
+    void prepareTiles(Camera const * const cameras[2]);
+    void createTexture(Texture * texture, Image const * image, GLuint depth);
+    void createTexture(Texture * texture, CompressedImage const * image, GLuint depth);
+    glm::ivec2 getImageMap(uint32_t image) const;
+    void loadImages();
+    void streamTextures();
+    void renderShadowMaps(Camera const * const cameras[2]);
+    uint64_t getLightSignature(Light const * light, glm::vec3 const eyes[2]) const;
+    void blendLight(Texture & texture);
+    void drawMesh(uint32_t mesh);
+    glm::ivec4 getScissor(Camera const * camera, glm::vec3 const & center, float radius) const;
+    glm::ivec4 getScissor(Camera const * const cameras[2], glm::vec3 const & center, float radius) const;
+    void bindPerModel();
+    
     uint32_t width;
     uint32_t height;
+    bool compact;
+    bool stereo;
     
     std::vector<Light const *> lights;
     std::vector<Model const *> models;
@@ -49,49 +109,136 @@ private:
     struct PerModel {
         glm::mat4 transform;
         glm::vec4 extra;
+        glm::vec4 normal[3]; // Note: columns of normal matrix, i.e. inverse transpose of transform
     };
-    std::vector<PerModel> permodel_data;
+    
+    // Note: models are grouped by mesh, then by texture class
+    std::vector<uint32_t> pergroup_offset;
+    
+    // Culling data, as structure of arrays to allow vectorization
+    std::vector<glm::mat4> permodel_transform;
+    std::vector<glm::vec4> permodel_normal;
+    std::vector<float> permodel_x;
+    std::vector<float> permodel_y;
+    std::vector<float> permodel_z;
+    std::vector<float> permodel_radius;
+    std::vector<uint8_t> permodel_visible;
+    std::vector<uint32_t> permodel_group;
+    std::vector<uint32_t> permodel_slot;
+    std::vector<uint32_t> perslot_model;
     
     struct Command {
         GLuint count;
         GLuint instanceCount;
-        GLuint first;
+        GLuint firstIndex;
+        GLint baseVertex;
         GLuint baseInstance;
     };
-    std::vector<Command> commands;
+    std::vector<Command> commands; // Note: only visible models
+    std::vector<uint32_t> perclass_offset;
+    
+    // Shadow casters relevant to each light, stored contiguously
+    // Note: depth-pass is used when the near plane is outside of all shadow volumes, as caps are not needed
+    std::vector<uint8_t> light_visible;
+    std::vector<uint8_t> light_zpass;
+    std::vector<uint32_t> light_offset;
+    std::vector<Command> light_commands;
+    std::vector<std::vector<Command>> perlight_commands; // Note: filled concurrently, then merged
+    
+    // Cube shadow maps, kept until light or casters change
+    // Note: signature is a hash of light position, range and casters transform
+    struct ShadowMap {
+        Texture texture;
+        uint64_t signature;
+    };
+    std::vector<uint64_t> light_signature;
+    std::map<Light const *, std::unique_ptr<ShadowMap>> shadow_maps;
+    Framebuffer shadow_framebuffer;
+    
+    // Light contribution of each light and camera, kept until something changes in light range or line of sight
+    // Note: light is only cached after being unchanged for two frames, to avoid useless copies
+    struct LightCache {
+        Texture texture;
+        Framebuffer framebuffer;
+        uint64_t signature;
+        bool allocated;
+        bool valid;
+    };
+    bool cached;
+    uint64_t view_signature; // Note: cameras are compared once per frame, as contributions are screen images
+    std::vector<uint64_t> light_cache_signature;
+    std::map<std::pair<Light const *, Camera const *>, std::unique_ptr<LightCache>> light_caches;
     
     // TODO maybe this mapping should not be done here?
     std::map<std::string, uint32_t> meshNames;
     std::map<std::string, uint32_t> imageNames;
     
     std::vector<Mesh> meshDatas;
-    std::vector<Image> imageDatas;
     
-    std::vector<glm::ivec2> meshMaps;
-    std::vector<glm::ivec2> imageMaps;
+    // Note: images are decoded asynchronously, hence they must not move
+    // Note: if compression is supported, only block-compressed images are loaded, and cached on disk
+    bool compressed;
+    std::vector<std::unique_ptr<Image>> imageDatas;
+    std::vector<std::unique_ptr<CompressedImage>> compressedDatas;
+    std::vector<std::future<bool>> imageLoads;
+    
+    // Note: first index, index count, base vertex and first adjacency index (with twice as many indices)
+    std::vector<glm::ivec4> meshMaps;
+    std::vector<glm::vec4> meshBounds;
+    std::vector<glm::ivec2> imageMaps; // Note: texture class and layer, class 0 being the white fallback
+    std::vector<std::vector<uint32_t>> classImages;
+    std::vector<uint32_t> pendingImages;
+    bool packed;
     
     Buffer geometry_buffer;
-    Buffer permodel_buffer;
+    Buffer element_buffer;
+    RingBuffer permodel_buffer;
     VertexArray array;
-    Texture * textures;
+    std::vector<std::unique_ptr<Texture>> textures; // Note: one array per texture class
+    
+    // Streamed textures are uploaded through a ring of pixel buffers
+    bool streaming;
+    std::vector<float> perclass_pixels;
+    RingBuffer streaming_buffer;
     
     Shader render_shader;
     Shader extrusion_shader;
     Shader shading_shader;
     Shader finalize_shader;
     Shader antialiasing_shader;
+    Shader tiled_shader;
+    Shader shadow_shader;
+    Shader copy_shader;
     
     Texture render_color;
     Texture render_position;
     Texture render_normal;
     Texture render_light;
     Texture render_depthStencil;
+    Texture render_depth; // Note: copy sampled in compact mode, as depth-stencil stays attached during shading
     Framebuffer render_framebuffer;
     Framebuffer render_light_framebuffer;
     
+    bool tiled;
+    GLuint tile_columns;
+    GLuint tile_rows;
+    std::vector<glm::vec4> tile_lights;
+    std::vector<glm::uvec2> tile_ranges;
+    std::vector<GLuint> tile_indices;
+    Buffer tile_lights_buffer;
+    Buffer tile_ranges_buffer;
+    Buffer tile_indices_buffer;
+    Texture tile_lights_texture;
+    Texture tile_ranges_texture;
+    Texture tile_indices_texture;
+    
     Texture processing_color[3];
     Framebuffer processing_framebuffer[3];
     
+    ThreadPool pool;
+    Profiler profiler;
+    Uploader uploader;
+    
 };
 
 #endif
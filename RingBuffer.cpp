@@ -0,0 +1,74 @@
+
+#include "RingBuffer.hpp"
+
+RingBuffer::RingBuffer(GLuint regions) : buffer(nullptr), size(0), count(regions), current(0), pointer(nullptr), fences(regions, nullptr) {
+    assert(regions > 0);
+}
+
+RingBuffer::~RingBuffer() {
+    for (GLuint i = 0; i < count; ++i)
+        if (fences[i])
+            glDeleteSync(fences[i]);
+    delete buffer;
+}
+
+Buffer * RingBuffer::getBuffer() const {
+    return buffer;
+}
+
+GLuint RingBuffer::getSize() const {
+    return size;
+}
+
+bool RingBuffer::reserve(GLuint size) {
+    if (buffer && size <= this->size)
+        return false;
+    
+    // GPU may still be reading from old buffer
+    for (GLuint i = 0; i < count; ++i)
+        wait(i);
+    if (buffer) {
+        buffer->bind(GL_ARRAY_BUFFER);
+        buffer->unmap();
+        delete buffer;
+    }
+    
+    // Grow geometrically to avoid frequent reallocations
+    this->size = std::max(size, this->size * 2);
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    buffer = new Buffer();
+    buffer->bind(GL_ARRAY_BUFFER);
+    buffer->setStorage(this->size * count, nullptr, flags);
+    pointer = (char *)buffer->map(0, this->size * count, flags);
+    current = 0;
+    return true;
+}
+
+void * RingBuffer::next() {
+    assert(buffer);
+    
+    // Commands issued since previous call are the ones reading current region
+    if (fences[current])
+        glDeleteSync(fences[current]);
+    fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    
+    // Move to next region, which may still be in use
+    current = (current + 1) % count;
+    wait(current);
+    return pointer + getOffset();
+}
+
+GLuint RingBuffer::getOffset() const {
+    return current * size;
+}
+
+void RingBuffer::wait(GLuint region) {
+    GLsync fence = fences[region];
+    if (!fence)
+        return;
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    while (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED && status != GL_WAIT_FAILED)
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    glDeleteSync(fence);
+    fences[region] = nullptr;
+}
@@ -0,0 +1,47 @@
+
+#ifndef GLOW_RINGBUFFER_HPP
+#define GLOW_RINGBUFFER_HPP
+
+#include "Common.hpp"
+#include "Buffer.hpp"
+
+// Persistently mapped buffer split in several regions, so that CPU writes one region while GPU reads the others
+class RingBuffer {
+public:
+    
+    RingBuffer(GLuint regions = 3);
+    ~RingBuffer();
+    
+    RingBuffer(RingBuffer const &) = delete;
+    RingBuffer & operator=(RingBuffer const &) = delete;
+    
+    Buffer * getBuffer() const;
+    
+    // Note: size of a single region
+    GLuint getSize() const;
+    
+    // Reallocate storage if regions are too small, returns true if underlying buffer was replaced
+    // Note: any binding to the previous buffer (e.g. in vertex arrays) must be updated
+    bool reserve(GLuint size);
+    
+    // Fence current region, then wait until next one is released by GPU
+    // Note: must be called once per frame, before writing anything
+    void * next();
+    
+    // Offset of current region in bytes
+    GLuint getOffset() const;
+    
+private:
+    
+    void wait(GLuint region);
+    
+    Buffer * buffer;
+    GLuint size;
+    GLuint count;
+    GLuint current;
+    char * pointer;
+    std::vector<GLsync> fences;
+    
+};
+
+#endif
@@ -2,10 +2,14 @@
 #include "Scene.hpp"
 #include "Window.hpp"
 
-Scene::Scene(Window * window) : window(window) {}
+Scene::Scene(Window * window, bool stereo, bool compact) : window(window), stereo(stereo), compact(compact) {}
 
 Scene::~Scene() {}
 
+Renderer * Scene::getRenderer() {
+    return &renderer;
+}
+
 bool Scene::initialize() {
     // TODO handle errors
     
@@ -13,7 +17,17 @@ bool Scene::initialize() {
     time = 0;
     
     // Prepare camera
-    camera.setProjection(glm::perspective(PI / 3.0f, (float)window->getWidth() / (float)window->getHeight(), 0.1f, 1000.0f));
+    float aspect = (float)window->getWidth() / (float)window->getHeight();
+    if (stereo)
+        aspect *= 0.5f;
+    camera.setProjection(glm::perspective(PI / 3.0f, aspect, 0.1f, 1000.0f));
+    
+    // Prepare fake eyes, with a typical interpupillary distance
+    for (int i = 0; i < 2; ++i) {
+        eyes[i].setParent(&camera);
+        eyes[i].setRelativeTransform(glm::translate(glm::mat4(1.0f), glm::vec3(i ? 0.032f : -0.032f, 0.0f, 0.0f)));
+        eyes[i].setProjection(camera.getProjection());
+    }
     
     // Prepare renderer
     uint32_t width, height;
@@ -21,10 +35,10 @@ bool Scene::initialize() {
         width = window->getHead()->getWidth();
         height = window->getHead()->getHeight();
     } else {
-        width = window->getWidth();
+        width = stereo ? window->getWidth() / 2 : window->getWidth();
         height = window->getHeight();
     }
-    renderer.initialize(width, height);
+    renderer.initialize(width, height, compact, stereo || window->getHead());
     renderer.loadImage("Crate.jpg");
     renderer.loadImage("Floor.jpg");
     renderer.loadImage("Metal.jpg");
@@ -36,6 +50,7 @@ bool Scene::initialize() {
     Model model;
     model.mesh = 0;
     model.color = 1;
+    model.rigid = true;
     model.setParent(plane);
     models.push_back(model);
     
@@ -61,9 +76,41 @@ bool Scene::initialize() {
     else
         listener.setParent(&camera);
     
+    // Prepare lights
+    light.setRelativePosition({-1.0f, 0.0f, 3.0f});
+    light.setRadius(5.0f);
+    light.setColor({0.2f, 0.4f, 1.0f});
+    if (window->getHead()) {
+        hand_model.color = 0;
+        hand_model.mesh = 1;
+        hand_model.setParent(window->getController(0));
+        hand_model.setRelativeTransform(glm::mat4(0.1, 0, 0, 0, 0, 0.1, 0, 0, 0, 0, 0.1, 0, 0, 0, 0, 1));
+        hand_light.setParent(window->getController(1));
+        hand_light.setRadius(6.0f);
+        hand_light.setColor({1.0f, 0.7f, 0.2f});
+    }
+    
+    link();
     return true;
 }
 
+void Scene::link() {
+    hierarchy.clear();
+    hierarchy.addActor(&camera);
+    hierarchy.addActor(&eyes[0]);
+    hierarchy.addActor(&eyes[1]);
+    hierarchy.addActor(&listener);
+    if (source)
+        hierarchy.addActor(source);
+    hierarchy.addActor(&light);
+    for (Model & model : models)
+        hierarchy.addActor(&model);
+    if (window->getHead()) {
+        hierarchy.addActor(&hand_model);
+        hierarchy.addActor(&hand_light);
+    }
+}
+
 void Scene::update() {
     
     // Update time
@@ -79,8 +126,10 @@ void Scene::update() {
         Model model;
         model.mesh = 1;
         model.color = 0;
+        model.rigid = true;
         model.setParent(body);
         models.push_back(model);
+        link();
         source->play();
     }
     
@@ -95,36 +144,26 @@ void Scene::update() {
     
     // Define render objects
     renderer.clear();
-    Light light;
-    light.setRelativePosition({-1.0f, 0.0f, 3.0f});
-    light.setRadius(5.0f);
-    light.setColor({0.2f, 0.4f, 1.0f});
     renderer.addLight(&light);
     for (Model & model : models)
         renderer.addModel(&model);
-    
-    // Special objects for VR
-    Light l;
-    Model m;
     if (window->getHead()) {
-        m.color = 0;
-        m.mesh = 1;
-        m.setParent(window->getController(0));
-        m.setRelativeTransform(glm::mat4(0.1, 0, 0, 0, 0, 0.1, 0, 0, 0, 0, 0.1, 0, 0, 0, 0, 1));
-        renderer.addModel(&m);
-        l.setParent(window->getController(1));
-        l.setRadius(6.0f);
-        l.setColor({1.0f, 0.7f, 0.2f});
-        renderer.addLight(&l);
+        renderer.addModel(&hand_model);
+        renderer.addLight(&hand_light);
     }
     
+    // Compute world transforms once for renderer and audio
+    hierarchy.update();
+    
     // Draw everything
-    renderer.prepare();
     if (window->getHead()) {
-        glViewport(0, 0, window->getHead()->getWidth(), window->getHead()->getHeight());
-        for (unsigned int i = 0; i < 2; ++i)
-            renderer.render(window->getHead()->getEye(i));
+        renderer.prepare(window->getHead()->getEye(0), window->getHead()->getEye(1));
+        renderer.render(window->getHead()->getEye(0), window->getHead()->getEye(1));
+    } else if (stereo) {
+        renderer.prepare(&eyes[0], &eyes[1]);
+        renderer.render(&eyes[0], &eyes[1]);
     } else {
+        renderer.prepare(&camera);
         glViewport(0, 0, window->getWidth(), window->getHeight());
         renderer.render(&camera);
     }
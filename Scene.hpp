@@ -4,6 +4,7 @@
 
 #include "Common.hpp"
 #include "Renderer.hpp"
+#include "Hierarchy.hpp"
 #include "Listener.hpp"
 #include "Source.hpp"
 #include "Window.hpp"
@@ -14,7 +15,9 @@
 class Scene {
 public:
     
-    Scene(Window * window);
+    // Note: without head-mounted display, stereo renders two fake eyes side-by-side on screen
+    // Note: compact selects the compact G-buffer of the renderer
+    Scene(Window * window, bool stereo = false, bool compact = false);
     ~Scene();
     
     Scene(Scene const &) = delete;
@@ -23,7 +26,14 @@ public:
     bool initialize();
     void update();
     
+    // Note: other renderer options may be changed after initialization
+    Renderer * getRenderer();
+    
 private:
+    
+    // Register actors to hierarchy
+    // Note: only needed when actors are added, or moved in memory
+    void link();
 
     Window * window;
     int width;
@@ -32,6 +42,10 @@ private:
     float time;
     
     Camera camera;
+    bool stereo;
+    bool compact;
+    Camera eyes[2];
+    Hierarchy hierarchy;
     Renderer renderer;
     
     Listener listener;
@@ -40,8 +54,13 @@ private:
     
     Physics physics;
     
+    Light light;
     std::vector<Model> models;
     
+    // Special objects for VR
+    Light hand_light;
+    Model hand_model;
+    
 };
 
 #endif
@@ -16,11 +16,20 @@ GLuint Shader::getHandle() const {
     return handle;
 }
 
-bool Shader::addSource(GLenum type, std::string const & code) {
+bool Shader::addSource(GLenum type, std::string const & code, std::string const & defines) {
     GLuint id = glCreateShader(type);
     if (!id)
         return false; // TODO report this properly?
-    char const * pointer = code.c_str();
+    std::string source = code;
+    if (!defines.empty()) {
+        size_t position = 0;
+        if (source.compare(0, 8, "#version") == 0) {
+            position = source.find('\n');
+            position = position == std::string::npos ? source.size() : position + 1;
+        }
+        source.insert(position, defines);
+    }
+    char const * pointer = source.c_str();
     glShaderSource(id, 1, &pointer, NULL);
     glCompileShader(id);
     GLint compiled;
@@ -41,7 +50,7 @@ bool Shader::addSource(GLenum type, std::string const & code) {
     return true;
 }
 
-bool Shader::addSourceFile(GLenum type, std::string const & path) {
+bool Shader::addSourceFile(GLenum type, std::string const & path, std::string const & defines) {
     FILE * file = fopen(path.c_str(), "rb");
     if (!file)
         return false;
@@ -54,7 +63,7 @@ bool Shader::addSourceFile(GLenum type, std::string const & path) {
         return false;
     }
     fclose(file);
-    return addSource(type, code);
+    return addSource(type, code, defines);
 }
 
 bool Shader::link() {
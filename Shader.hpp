@@ -15,8 +15,9 @@ public:
     
     GLuint getHandle() const;
     
-    bool addSource(GLenum type, std::string const & code);
-    bool addSourceFile(GLenum type, std::string const & path);
+    // Note: defines are inserted right after version directive
+    bool addSource(GLenum type, std::string const & code, std::string const & defines = "");
+    bool addSourceFile(GLenum type, std::string const & path, std::string const & defines = "");
     
     bool link();
     
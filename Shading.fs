@@ -8,20 +8,87 @@ uniform vec3 light_position;
 uniform vec3 light_color;
 uniform float light_radius;
 
+uniform bool shadow_mapped;
+uniform samplerCubeShadow shadow_map;
+uniform float shadow_near;
+
+#ifdef COMPACT
+
+#ifdef STEREO
+uniform mat4 inverse_view_projection[2];
+#else
+uniform mat4 inverse_view_projection;
+#endif
+uniform sampler2D texture_depth;
+
+#else
+
 uniform sampler2D texture_position;
+
+#endif
+
 uniform sampler2D texture_normal;
 
+#ifdef COMPACT
+
+vec3 decode(vec2 e) {
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+#endif
+
+vec3 getPosition() {
+#ifdef COMPACT
+    float depth = texture(texture_depth, v_coordinate).r;
+#ifdef STEREO
+    // Both eyes are side-by-side
+    int eye = v_coordinate.x < 0.5 ? 0 : 1;
+    vec2 coordinate = vec2(v_coordinate.x * 2.0 - float(eye), v_coordinate.y);
+    vec4 p = inverse_view_projection[eye] * vec4(vec3(coordinate, depth) * 2.0 - 1.0, 1.0);
+#else
+    vec4 p = inverse_view_projection * vec4(vec3(v_coordinate, depth) * 2.0 - 1.0, 1.0);
+#endif
+    return p.xyz / p.w;
+#else
+    return texture2D(texture_position, v_coordinate).xyz;
+#endif
+}
+
+vec3 getNormal() {
+#ifdef COMPACT
+    return decode(texture(texture_normal, v_coordinate).xy);
+#else
+    return texture2D(texture_normal, v_coordinate).xyz;
+#endif
+}
+
+float getShadow(vec3 position) {
+    
+    // Compute depth in the cube face, which uses major axis as view direction
+    vec3 delta = position - light_position;
+    float z = max(abs(delta.x), max(abs(delta.y), abs(delta.z)));
+    float f = light_radius;
+    float n = shadow_near;
+    float depth = 0.5 * (f + n) / (f - n) + 0.5 - f * n / ((f - n) * z);
+    return texture(shadow_map, vec4(delta, depth));
+}
+
 void main() {
 
     // Get geometry properties
-    vec3 position = texture2D(texture_position, v_coordinate).xyz;
-    vec3 normal = texture2D(texture_normal, v_coordinate).xyz;
+    vec3 position = getPosition();
+    vec3 normal = getNormal();
     vec3 delta = light_position - position;
     float distance = length(delta);
     
     // Fragment squared distance
     float distance_factor = max(distance / light_radius, 0.0);
-    distance_factor = 1.0 - distance_factor * distance_factor;
+    distance_factor = max(1.0 - distance_factor * distance_factor, 0.0);
 
     // Fragment orientation
     float exposition = dot(delta, normal) / (distance * length(normal));
@@ -29,5 +96,7 @@ void main() {
 
     // Combine factors to produce final illumination
     float factor = distance_factor * exposition_factor;
+    if (shadow_mapped)
+        factor *= getShadow(position);
     color = vec4(light_color * factor, 1.0);
 }
@@ -3,7 +3,7 @@
 
 #include "Texture.hpp"
 
-Texture::Texture() : width(0), height(0), depth(0), mipmapped(false), depthStencil(false), multisampling(0) {
+Texture::Texture() : width(0), height(0), depth(0), mipmapped(false), depthStencil(false), buffer(false), cube(false), multisampling(0), format(GL_NONE), levels(0), base(0) {
     glGenTextures(1, &handle);
 }
 
@@ -21,6 +21,8 @@ void Texture::createColor(Image const & image, bool mipmapped) {
     depth = 0;
     this->mipmapped = mipmapped;
     depthStencil = false;
+    buffer = false;
+    cube = false;
     multisampling = 0;
     glBindTexture(GL_TEXTURE_2D, handle);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.getWidth(), image.getHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, image.getPointer());
@@ -39,6 +41,8 @@ void Texture::createColor(uint32_t width, uint32_t height, bool floating, GLuint
     depth = 0;
     mipmapped = false;
     depthStencil = false;
+    buffer = false;
+    cube = false;
     this->multisampling = multisampling;
     if (multisampling) {
         glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, handle);
@@ -53,12 +57,28 @@ void Texture::createColor(uint32_t width, uint32_t height, bool floating, GLuint
     }
 }
 
+void Texture::createColor(uint32_t width, uint32_t height, GLenum internalFormat, GLenum format, GLenum type) {
+    this->width = width;
+    this->height = height;
+    depth = 0;
+    mipmapped = false;
+    depthStencil = false;
+    buffer = false;
+    cube = false;
+    multisampling = 0;
+    glBindTexture(GL_TEXTURE_2D, handle);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+}
+
 void Texture::createDepthStencil(uint32_t width, uint32_t height, GLuint multisampling) {
     this->width = width;
     this->height = height;
     depth = 0;
     mipmapped = false;
     depthStencil = true;
+    buffer = false;
+    cube = false;
     this->multisampling = multisampling;
     if (multisampling) {
         glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, handle);
@@ -66,6 +86,10 @@ void Texture::createDepthStencil(uint32_t width, uint32_t height, GLuint multisa
     } else {
         glBindTexture(GL_TEXTURE_2D, handle);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+        
+        // Allow depth to be sampled
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     }
 }
 
@@ -74,22 +98,165 @@ void Texture::createColorArray(std::vector<Image const *> images, bool mipmapped
         assert(false);
         return;
     }
-    width = images[0]->getWidth();
-    height = images[0]->getHeight();
-    depth = images.size();
+    createColorArray(images[0]->getWidth(), images[0]->getHeight(), images.size(), mipmapped);
+    for (uint32_t i = 0; i < depth; ++i)
+        setLayer(i, images[i]->getPointer());
+    if (mipmapped)
+        generateMipmaps();
+}
+
+void Texture::createColorArray(uint32_t width, uint32_t height, uint32_t depth, bool mipmapped) {
+    this->width = width;
+    this->height = height;
+    this->depth = depth;
     this->mipmapped = mipmapped;
     depthStencil = false;
+    buffer = false;
+    cube = false;
     multisampling = 0;
+    format = GL_RGBA8;
+    levels = 1;
+    base = 0;
+    if (mipmapped)
+        while (std::max(width, height) >> levels)
+            ++levels;
     glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
-    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, depth, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    for (uint32_t i = 0; i < depth; ++i)
-        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, images[i]->getPointer());
-    if (mipmapped) {
-        glHint(GL_GENERATE_MIPMAP_HINT, GL_NICEST);
-        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
-        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    } else
-        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, width, height, depth);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+}
+
+void Texture::createCompressedArray(std::vector<CompressedImage const *> images, GLuint base) {
+    if (images.empty()) {
+        assert(false);
+        return;
+    }
+    createCompressedArray(images[0]->getWidth(), images[0]->getHeight(), images.size(), images[0]->getFormat(), images[0]->getLevelCount(), base);
+    for (GLuint level = this->base; level < levels; ++level)
+        for (uint32_t i = 0; i < depth; ++i) {
+            assert(images[i]->getFormat() == format && images[i]->getLevelSize(level) == images[0]->getLevelSize(level));
+            setCompressedLayer(i, level, images[i]->getLevelSize(level), images[i]->getLevelPointer(level));
+        }
+}
+
+void Texture::createCompressedArray(uint32_t width, uint32_t height, uint32_t depth, GLenum format, GLuint levels, GLuint base) {
+    this->width = width;
+    this->height = height;
+    this->depth = depth;
+    this->format = format;
+    this->levels = levels;
+    this->base = std::min(base, levels - 1);
+    mipmapped = levels > 1;
+    depthStencil = false;
+    buffer = false;
+    cube = false;
+    multisampling = 0;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels - this->base, format, std::max(width >> this->base, 1u), std::max(height >> this->base, 1u), depth);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+}
+
+GLuint Texture::getBaseLevel() const {
+    return base;
+}
+
+void Texture::setBaseLevel(GLuint base) {
+    base = std::min(base, levels - 1);
+    if (base != this->base)
+        reallocate(depth, base);
+}
+
+void Texture::setDepth(uint32_t depth) {
+    if (depth != this->depth)
+        reallocate(depth, base);
+}
+
+void Texture::setLayer(GLuint layer, void const * pointer) {
+    assert(format == GL_RGBA8 && layer < depth);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pointer);
+}
+
+void Texture::setCompressedLayer(GLuint layer, GLuint level, GLuint size, void const * pointer) {
+    assert(level >= base && level < levels && layer < depth);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - base, 0, 0, layer, std::max(width >> level, 1u), std::max(height >> level, 1u), 1, format, size, pointer);
+}
+
+void Texture::generateMipmaps() {
+    assert(mipmapped && format == GL_RGBA8);
+    bind();
+    glHint(GL_GENERATE_MIPMAP_HINT, GL_NICEST);
+    glGenerateMipmap(depth ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D);
+}
+
+void Texture::reallocate(uint32_t depth, GLuint base) {
+    if (!this->depth || !levels) {
+        assert(false);
+        return;
+    }
+    
+    // Immutable storage cannot be resized, hence sampling parameters are moved to a new texture
+    GLint filters[4];
+    GLfloat anisotropy;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+    glGetTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, &filters[0]);
+    glGetTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, &filters[1]);
+    glGetTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, &filters[2]);
+    glGetTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, &filters[3]);
+    glGetTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, &anisotropy);
+    GLuint previous = handle;
+    glGenTextures(1, &handle);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels - base, format, std::max(width >> base, 1u), std::max(height >> base, 1u), depth);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filters[0]);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filters[1]);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, filters[2]);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, filters[3]);
+    glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+    
+    // Copy levels and layers that are resident in both, without going through CPU
+    uint32_t layers = std::min(depth, this->depth);
+    for (GLuint level = std::max(base, this->base); level < levels; ++level)
+        glCopyImageSubData(previous, GL_TEXTURE_2D_ARRAY, level - this->base, 0, 0, 0, handle, GL_TEXTURE_2D_ARRAY, level - base, 0, 0, 0, std::max(width >> level, 1u), std::max(height >> level, 1u), layers);
+    glDeleteTextures(1, &previous);
+    this->depth = depth;
+    this->base = base;
+}
+
+void Texture::createBuffer(Buffer const & buffer, GLenum format) {
+    width = 0;
+    height = 0;
+    depth = 0;
+    mipmapped = false;
+    depthStencil = false;
+    this->buffer = true;
+    cube = false;
+    multisampling = 0;
+    glBindTexture(GL_TEXTURE_BUFFER, handle);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer.getHandle());
+}
+
+void Texture::createDepthCube(uint32_t size) {
+    width = size;
+    height = size;
+    depth = 0;
+    mipmapped = false;
+    depthStencil = false;
+    buffer = false;
+    cube = true;
+    multisampling = 0;
+    glBindTexture(GL_TEXTURE_CUBE_MAP, handle);
+    for (GLenum face = 0; face < 6; ++face)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    
+    // Use hardware comparison, with bilinear filtering of the results
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
 }
 
 uint32_t Texture::getWidth() const {
@@ -116,12 +283,20 @@ bool Texture::isDepthStencil() const {
     return depthStencil;
 }
 
+bool Texture::isBuffer() const {
+    return buffer;
+}
+
+bool Texture::isCube() const {
+    return cube;
+}
+
 GLuint Texture::getMultisampling() const {
     return multisampling;
 }
 
 void Texture::bind() {
-    glBindTexture(multisampling ? GL_TEXTURE_2D_MULTISAMPLE : depth ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, handle);
+    glBindTexture(buffer ? GL_TEXTURE_BUFFER : cube ? GL_TEXTURE_CUBE_MAP : multisampling ? GL_TEXTURE_2D_MULTISAMPLE : depth ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, handle);
 }
 
 void Texture::bind(int slot) {
@@ -130,7 +305,7 @@ void Texture::bind(int slot) {
 }
 
 void Texture::setInterpolation(bool linear) {
-    if (depthStencil || multisampling) {
+    if (depthStencil || multisampling || buffer || cube) {
         assert(false);
         return;
     }
@@ -143,7 +318,7 @@ void Texture::setInterpolation(bool linear) {
 }
 
 void Texture::setAnisotropy(bool enabled) {
-    if (depthStencil || multisampling) {
+    if (depthStencil || multisampling || buffer || cube) {
         assert(false);
         return;
     }
@@ -157,7 +332,7 @@ void Texture::setAnisotropy(bool enabled) {
 }
 
 void Texture::setBorder(bool clamp) {
-    if (depthStencil || multisampling) {
+    if (depthStencil || multisampling || buffer || cube) {
         assert(false);
         return;
     }
@@ -168,7 +343,7 @@ void Texture::setBorder(bool clamp) {
 }
 
 void Texture::setBorder(glm::vec4 const & color) {
-    if (depthStencil || multisampling) {
+    if (depthStencil || multisampling || buffer || cube) {
         assert(false);
         return;
     }
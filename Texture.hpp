@@ -3,7 +3,9 @@
 #define GLOW_TEXTURE2D_HPP
 
 #include "Common.hpp"
+#include "Buffer.hpp"
 #include "Image.hpp"
+#include "CompressedImage.hpp"
 
 class Texture {
 public:
@@ -19,16 +21,40 @@ public:
     // Note: can only be called once, and should not be bound before
     void createColor(Image const & image, bool mipmapped = false);
     void createColor(uint32_t width, uint32_t height, bool floating = false, GLuint multisampling = 0);
+    void createColor(uint32_t width, uint32_t height, GLenum internalFormat, GLenum format, GLenum type);
     void createDepthStencil(uint32_t width, uint32_t height, GLuint multisampling = 0);
-    void createColorArray(std::vector<Image const *> images, bool mipmapped = false);
+    void createColorArray(std::vector<Image const *> images, bool mipmapped = false); // Note: images must share size
+    void createColorArray(uint32_t width, uint32_t height, uint32_t depth, bool mipmapped = false); // Note: layers are undefined until set
+    
+    // Note: images must share size, format and levels, and only levels from base are resident
+    void createCompressedArray(std::vector<CompressedImage const *> images, GLuint base = 0);
+    void createCompressedArray(uint32_t width, uint32_t height, uint32_t depth, GLenum format, GLuint levels, GLuint base = 0);
+    void createBuffer(Buffer const & buffer, GLenum format);
+    void createDepthCube(uint32_t size); // Note: sampled with depth comparison
     
     uint32_t getWidth() const;
     uint32_t getHeight() const;
     uint32_t getDepth() const; // Note: zero for non-array textures
     
+    // First resident level of an array, i.e. offset between image and texture levels
+    // Note: storage is reallocated and remaining levels copied on GPU, new finer levels must then be uploaded
+    GLuint getBaseLevel() const;
+    void setBaseLevel(GLuint base);
+    
+    // Change number of layers of an array, the same way, new layers being undefined
+    void setDepth(uint32_t depth);
+    
+    // Upload a single layer, from a pixel unpack buffer offset if one is bound
+    // Note: uncompressed arrays only receive their first level, use generateMipmaps afterward
+    void setLayer(GLuint layer, void const * pointer);
+    void setCompressedLayer(GLuint layer, GLuint level, GLuint size, void const * pointer);
+    void generateMipmaps();
+    
     bool isArray() const;
     bool isMipmapped() const;
     bool isDepthStencil() const;
+    bool isBuffer() const;
+    bool isCube() const;
     GLuint getMultisampling() const; // Note: zero for non-multisampled textures
     
     void bind();
@@ -51,9 +77,18 @@ private:
     uint32_t depth;
     bool mipmapped;
     bool depthStencil;
+    bool buffer;
+    bool cube;
     GLuint multisampling;
     
-    // TODO use glTexStorage instead? https://www.opengl.org/wiki/Common_Mistakes#Creating_a_complete_texture
+    // Immutable storage of arrays
+    GLenum format;
+    GLuint levels;
+    GLuint base;
+    
+    void reallocate(uint32_t depth, GLuint base);
+    
+    // TODO use glTexStorage for non-array textures as well
     // TODO http://stackoverflow.com/questions/12372058/how-to-use-gl-texture-2d-array-in-opengl-3-2
     
 };
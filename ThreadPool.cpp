@@ -0,0 +1,117 @@
+
+#include "ThreadPool.hpp"
+
+#include <atomic>
+
+ThreadPool::ThreadPool(size_t workers) : stopping(false) {
+    setWorkerCount(workers);
+}
+
+ThreadPool::~ThreadPool() {
+    stop();
+}
+
+size_t ThreadPool::getWorkerCount() const {
+    return threads.size();
+}
+
+void ThreadPool::setWorkerCount(size_t workers) {
+    stop();
+    stopping = false;
+    for (size_t i = 0; i < workers; ++i)
+        threads.emplace_back(&ThreadPool::work, this);
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    if (threads.empty()) {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    condition.notify_one();
+}
+
+void ThreadPool::run(size_t count, size_t chunk, std::function<void(size_t begin, size_t end)> const & function) {
+    if (count == 0)
+        return;
+    chunk = std::max<size_t>(chunk, 1);
+    size_t chunks = (count + chunk - 1) / chunk;
+    
+    // Small ranges are not worth the synchronization
+    size_t helpers = std::min(threads.size(), chunks - 1);
+    if (helpers == 0) {
+        function(0, count);
+        return;
+    }
+    
+    // Each participant takes chunks until none is left
+    // Note: state is shared, as helpers may only start after everything is done (e.g. if workers are busy decoding)
+    struct State {
+        std::atomic<size_t> next;
+        std::mutex mutex;
+        std::condition_variable condition;
+        size_t active;
+    };
+    std::shared_ptr<State> state = std::make_shared<State>();
+    state->next = 0;
+    state->active = 0;
+    std::function<void(size_t begin, size_t end)> const * target = &function;
+    auto consume = [state, target, count, chunk, chunks]() {
+        for (size_t i = state->next++; i < chunks; i = state->next++)
+            (*target)(i * chunk, std::min(count, (i + 1) * chunk));
+    };
+    for (size_t i = 0; i < helpers; ++i)
+        submit([state, consume, chunks]() {
+            
+            // Only join if chunks are left, otherwise caller may have returned already
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (state->next >= chunks)
+                    return;
+                ++state->active;
+            }
+            consume();
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (--state->active == 0)
+                state->condition.notify_one();
+        });
+    consume();
+    
+    // Wait for helpers that are still processing a chunk, as they reference the function
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->condition.wait(lock, [&]() { return state->active == 0; });
+}
+
+size_t ThreadPool::getDefaultWorkerCount() {
+    size_t cores = std::thread::hardware_concurrency();
+    return cores > 1 ? cores - 1 : 0;
+}
+
+void ThreadPool::work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for (std::thread & thread : threads)
+        thread.join();
+    threads.clear();
+}
@@ -0,0 +1,68 @@
+
+#ifndef GLOW_THREADPOOL_HPP
+#define GLOW_THREADPOOL_HPP
+
+#include "Common.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+// Fixed set of worker threads consuming a shared task queue
+class ThreadPool {
+public:
+    
+    // Note: zero workers means that everything runs on the calling thread
+    ThreadPool(size_t workers = 0);
+    ~ThreadPool();
+    
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool & operator=(ThreadPool const &) = delete;
+    
+    // Note: pending tasks are completed before workers are replaced
+    size_t getWorkerCount() const;
+    void setWorkerCount(size_t workers);
+    
+    // Queue task for asynchronous execution
+    void submit(std::function<void()> task);
+    
+    // Queue task and get its result once done
+    template <typename T>
+    std::future<T> async(std::function<T()> function);
+    
+    // Split range in chunks processed concurrently, including on the calling thread, and wait for completion
+    // Note: busy workers do not delay completion, as the calling thread takes over chunks that are not claimed
+    void run(size_t count, size_t chunk, std::function<void(size_t begin, size_t end)> const & function);
+    
+    // Number of workers matching hardware, keeping one core for the calling thread
+    static size_t getDefaultWorkerCount();
+    
+private:
+    
+    void work();
+    void stop();
+    
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping;
+    
+};
+
+template <typename T>
+std::future<T> ThreadPool::async(std::function<T()> function) {
+    
+    // Note: task is shared, as queue only accepts copyable functions
+    std::shared_ptr<std::packaged_task<T()>> task = std::make_shared<std::packaged_task<T()>>(std::move(function));
+    std::future<T> result = task->get_future();
+    submit([task]() {
+        (*task)();
+    });
+    return result;
+}
+
+#endif
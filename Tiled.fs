@@ -0,0 +1,102 @@
+#version 330 core
+
+in vec2 v_coordinate;
+
+out vec4 color;
+
+uniform int tile_size;
+uniform int tile_columns;
+
+#ifdef COMPACT
+
+#ifdef STEREO
+uniform mat4 inverse_view_projection[2];
+#else
+uniform mat4 inverse_view_projection;
+#endif
+uniform sampler2D texture_depth;
+
+#else
+
+uniform sampler2D texture_position;
+
+#endif
+
+uniform sampler2D texture_normal;
+
+// Two texels per light, i.e. position and radius, then color
+uniform samplerBuffer light_data;
+
+// Offset and count in index list for each tile
+uniform usamplerBuffer tile_data;
+uniform usamplerBuffer index_data;
+
+#ifdef COMPACT
+
+vec3 decode(vec2 e) {
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+#endif
+
+vec3 getPosition() {
+#ifdef COMPACT
+    float depth = texture(texture_depth, v_coordinate).r;
+#ifdef STEREO
+    // Both eyes are side-by-side
+    int eye = v_coordinate.x < 0.5 ? 0 : 1;
+    vec2 coordinate = vec2(v_coordinate.x * 2.0 - float(eye), v_coordinate.y);
+    vec4 p = inverse_view_projection[eye] * vec4(vec3(coordinate, depth) * 2.0 - 1.0, 1.0);
+#else
+    vec4 p = inverse_view_projection * vec4(vec3(v_coordinate, depth) * 2.0 - 1.0, 1.0);
+#endif
+    return p.xyz / p.w;
+#else
+    return texture2D(texture_position, v_coordinate).xyz;
+#endif
+}
+
+vec3 getNormal() {
+#ifdef COMPACT
+    return decode(texture(texture_normal, v_coordinate).xy);
+#else
+    return texture2D(texture_normal, v_coordinate).xyz;
+#endif
+}
+
+void main() {
+
+    // Get geometry properties
+    vec3 position = getPosition();
+    vec3 normal = getNormal();
+
+    // Find lights affecting this tile
+    ivec2 tile = ivec2(gl_FragCoord.xy) / tile_size;
+    uvec2 range = texelFetch(tile_data, tile.y * tile_columns + tile.x).xy;
+
+    // Accumulate illumination, using the same model as single light shading
+    vec3 total = vec3(0.0, 0.0, 0.0);
+    for (uint i = range.x; i < range.x + range.y; ++i) {
+        int light = int(texelFetch(index_data, int(i)).x);
+        vec4 light_position = texelFetch(light_data, light * 2);
+        vec3 light_color = texelFetch(light_data, light * 2 + 1).rgb;
+        vec3 delta = light_position.xyz - position;
+        float distance = length(delta);
+
+        // Fragment squared distance, clamped as tiles are only coarse bounds
+        float distance_factor = max(distance / light_position.w, 0.0);
+        distance_factor = max(1.0 - distance_factor * distance_factor, 0.0);
+
+        // Fragment orientation
+        float exposition = dot(delta, normal) / (distance * length(normal));
+        float exposition_factor = max(exposition, 0.0);
+
+        total += light_color * (distance_factor * exposition_factor);
+    }
+    color = vec4(total, 1.0);
+}
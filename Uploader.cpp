@@ -0,0 +1,200 @@
+
+#include "Uploader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+Uploader::Uploader(ThreadPool & pool, GLuint capacity) : pool(pool), capacity(capacity), head(0), used(0) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    buffer.bind(GL_PIXEL_UNPACK_BUFFER);
+    buffer.setStorage(capacity, nullptr, flags);
+    pointer = (char *)buffer.map(0, capacity, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+Uploader::~Uploader() {
+    
+    // Workers may still be writing to staging memory
+    for (auto const & upload : pending) {
+        while (!upload->copied)
+            std::this_thread::yield();
+        if (upload->fence)
+            glDeleteSync(upload->fence);
+    }
+    buffer.bind(GL_PIXEL_UNPACK_BUFFER);
+    buffer.unmap();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void Uploader::upload(Texture * texture, GLuint layer, Image const * image, std::function<void()> done) {
+    Upload * upload = new Upload();
+    upload->texture = texture;
+    upload->layer = layer;
+    upload->image = image;
+    upload->compressed = nullptr;
+    upload->first = 0;
+    upload->size = image->getWidth() * image->getHeight() * 4;
+    upload->done = done;
+    queue(upload);
+}
+
+void Uploader::upload(Texture * texture, GLuint layer, CompressedImage const * image, std::function<void()> done) {
+    
+    // Only resident levels are needed, and they are contiguous
+    Upload * upload = new Upload();
+    upload->texture = texture;
+    upload->layer = layer;
+    upload->image = nullptr;
+    upload->compressed = image;
+    upload->first = texture->getBaseLevel();
+    upload->size = 0;
+    for (GLuint level = upload->first; level < image->getLevelCount(); ++level)
+        upload->size += image->getLevelSize(level);
+    upload->done = done;
+    queue(upload);
+}
+
+size_t Uploader::update() {
+    
+    // Release staging memory of completed uploads, in submission order
+    while (!pending.empty() && pending.front()->fence) {
+        Upload * upload = pending.front().get();
+        GLenum status = glClientWaitSync(upload->fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(upload->fence);
+        used -= upload->reserved;
+        pending.pop_front();
+    }
+    
+    // Issue uploads whose copy is complete, while next frames are being prepared
+    size_t count = 0;
+    for (auto const & upload : pending) {
+        if (upload->fence)
+            continue;
+        if (!upload->copied) {
+            ++count;
+            continue;
+        }
+        
+        // Cancelled uploads only need a fence, so that their memory is released in order
+        if (upload->texture) {
+            buffer.bind(GL_PIXEL_UNPACK_BUFFER);
+            issue(upload.get(), (char const *)(intptr_t)upload->offset);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        upload->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    
+    // Start copying waiting uploads, as long as there is enough staging memory
+    while (!waiting.empty()) {
+        Upload * upload = waiting.front().get();
+        
+        // Images larger than staging memory are uploaded directly, which may block
+        if (upload->size > capacity) {
+            issue(upload, upload->image ? (char const *)upload->image->getPointer() : (char const *)upload->compressed->getLevelPointer(upload->first));
+            waiting.pop_front();
+            continue;
+        }
+        if (!allocate(upload))
+            break;
+        pending.push_back(std::move(waiting.front()));
+        waiting.pop_front();
+        char * target = pointer + upload->offset;
+        pool.submit([upload, target]() {
+            char const * source = upload->image ? (char const *)upload->image->getPointer() : (char const *)upload->compressed->getLevelPointer(upload->first);
+            memcpy(target, source, upload->size);
+            upload->copied = true;
+        });
+        ++count;
+    }
+    
+    // Regenerate mipmaps once per texture
+    for (Texture * texture : mipmapped)
+        texture->generateMipmaps();
+    mipmapped.clear();
+    return count + waiting.size();
+}
+
+void Uploader::flush() {
+    while (update() > 0) {
+        
+        // Oldest upload either needs to be copied, or to be consumed by GPU to release memory
+        if (!pending.empty() && pending.front()->fence)
+            glClientWaitSync(pending.front()->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void Uploader::cancel() {
+    
+    // Uploads not started yet are simply dropped
+    waiting.clear();
+    mipmapped.clear();
+    
+    // Uploads being copied keep their staging memory, but are not issued anymore
+    for (auto const & upload : pending)
+        if (!upload->fence) {
+            upload->texture = nullptr;
+            upload->done = nullptr;
+        }
+}
+
+void Uploader::queue(Upload * upload) {
+    upload->offset = 0;
+    upload->reserved = 0;
+    upload->copied = false;
+    upload->fence = nullptr;
+    waiting.emplace_back(upload);
+}
+
+bool Uploader::allocate(Upload * upload) {
+    
+    // Staging memory is used as a ring, as uploads are released in submission order
+    // Note: when wrapping, the unused end of the buffer is reserved as well
+    if (used == 0)
+        head = 0;
+    if (used + upload->size > capacity)
+        return false;
+    GLuint tail = (head + capacity - used) % capacity;
+    if (head >= tail) {
+        if (upload->size <= capacity - head) {
+            upload->offset = head;
+            upload->reserved = upload->size;
+        } else if (upload->size <= tail) {
+            upload->offset = 0;
+            upload->reserved = capacity - head + upload->size;
+        } else
+            return false;
+    } else {
+        if (upload->size > tail - head)
+            return false;
+        upload->offset = head;
+        upload->reserved = upload->size;
+    }
+    head = (upload->offset + upload->size) % capacity;
+    used += upload->reserved;
+    return true;
+}
+
+void Uploader::issue(Upload * upload, char const * source) {
+    Texture * texture = upload->texture;
+    if (upload->image) {
+        texture->setLayer(upload->layer, source);
+        if (texture->isMipmapped() && std::find(mipmapped.begin(), mipmapped.end(), texture) == mipmapped.end())
+            mipmapped.push_back(texture);
+    } else {
+        
+        // Levels may have been released by streaming in the meantime
+        // Note: finer levels added by streaming are uploaded by streaming itself
+        char const * base = (char const *)upload->compressed->getLevelPointer(upload->first);
+        for (GLuint level = std::max(upload->first, texture->getBaseLevel()); level < upload->compressed->getLevelCount(); ++level) {
+            GLuint offset = (char const *)upload->compressed->getLevelPointer(level) - base;
+            texture->setCompressedLayer(upload->layer, level, upload->compressed->getLevelSize(level), source + offset);
+        }
+    }
+    if (upload->done)
+        upload->done();
+}
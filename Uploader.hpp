@@ -0,0 +1,72 @@
+
+#ifndef GLOW_UPLOADER_HPP
+#define GLOW_UPLOADER_HPP
+
+#include "Common.hpp"
+#include "Buffer.hpp"
+#include "Texture.hpp"
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <deque>
+
+// Asynchronous texture uploads, staged in a persistently mapped pixel buffer
+// Note: images are copied to staging memory by workers, then transferred by the driver without blocking
+class Uploader {
+public:
+    
+    Uploader(ThreadPool & pool, GLuint capacity = 32 << 20);
+    ~Uploader();
+    
+    Uploader(Uploader const &) = delete;
+    Uploader & operator=(Uploader const &) = delete;
+    
+    // Queue upload of an image into an array layer, callback being invoked once commands are issued
+    // Note: image and texture must stay valid until then (texture only until cancelled), and must share size (and format for compressed ones)
+    void upload(Texture * texture, GLuint layer, Image const * image, std::function<void()> done = nullptr);
+    void upload(Texture * texture, GLuint layer, CompressedImage const * image, std::function<void()> done = nullptr);
+    
+    // Issue copied uploads, release staging memory of completed ones and start copying waiting ones
+    // Note: must be called regularly on rendering thread, returns number of uploads not yet issued
+    size_t update();
+    
+    // Issue every queued upload, blocking until copies are done and staging memory is available
+    void flush();
+    
+    // Drop every upload not issued yet, without invoking callbacks, so that their textures may be destroyed
+    // Note: staging memory of uploads being copied is still released in order by update
+    void cancel();
+    
+private:
+    
+    struct Upload {
+        Texture * texture;
+        GLuint layer;
+        Image const * image;
+        CompressedImage const * compressed;
+        GLuint first; // Note: first level included in staging memory, for compressed images
+        GLuint size;
+        GLuint offset;
+        GLuint reserved;
+        std::atomic<bool> copied;
+        GLsync fence;
+        std::function<void()> done;
+    };
+    
+    void queue(Upload * upload);
+    bool allocate(Upload * upload);
+    void issue(Upload * upload, char const * source);
+    
+    ThreadPool & pool;
+    Buffer buffer;
+    char * pointer;
+    GLuint capacity;
+    GLuint head;
+    GLuint used;
+    std::deque<std::unique_ptr<Upload>> waiting;
+    std::deque<std::unique_ptr<Upload>> pending;
+    std::vector<Texture *> mipmapped;
+    
+};
+
+#endif
@@ -313,12 +313,14 @@ bool Window::update() {
         glm::mat4 t(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
         if (device[vr::k_unTrackedDeviceIndex_Hmd].bPoseIsValid) {
             head->transform = t * toGlm(device[vr::k_unTrackedDeviceIndex_Hmd].mDeviceToAbsoluteTracking);
+            head->version = Head::stamp();
             head->velocity = glm::vec3(t * glm::vec4(toGlm(device[vr::k_unTrackedDeviceIndex_Hmd].vVelocity), 0.0f));
             // TODO angular velocity
         }
         for (unsigned i = 0; i < sizeof(controller) / sizeof(controller[0]); ++i)
             if (controller[i]->index >= 0) {
                 controller[i]->transform = t * toGlm(device[controller[i]->index].mDeviceToAbsoluteTracking);
+                controller[i]->version = Controller::stamp();
                 controller[i]->velocity = glm::vec3(t * glm::vec4(toGlm(device[controller[i]->index].vVelocity), 0.0f));
                 controller[i]->current ^= 1;
                 hmd->GetControllerState(controller[i]->index, &controller[i]->state[controller[i]->current]);
@@ -0,0 +1,81 @@
+
+#include "Mesh.hpp"
+#include "ThreadPool.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+namespace {
+
+// Write a square grid of quads as an OBJ file, split in two triangles each
+bool writeGrid(std::string const & path, int size) {
+    FILE * file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+    for (int y = 0; y <= size; ++y)
+        for (int x = 0; x <= size; ++x)
+            fprintf(file, "v %f 0 %f\n", (float)x / size, (float)y / size);
+    fprintf(file, "vn 0 1 0\n");
+    for (int y = 0; y < size; ++y)
+        for (int x = 0; x < size; ++x) {
+            int a = y * (size + 1) + x + 1;
+            int b = a + 1;
+            int c = a + size + 1;
+            int d = c + 1;
+            fprintf(file, "f %d//1 %d//1 %d//1\n", a, c, b);
+            fprintf(file, "f %d//1 %d//1 %d//1\n", b, c, d);
+        }
+    return fclose(file) == 0;
+}
+
+double getMilliseconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+// Time OBJ parsing, index building and binary cache loading on synthetic meshes from 1k to 1M triangles
+int main(int argc, char** argv) {
+    std::string path = argc > 1 ? argv[1] : "benchmark.obj";
+    std::string cache = path + ".mesh";
+    ThreadPool pool(ThreadPool::getDefaultWorkerCount());
+    int const sizes[] = {23, 71, 224, 708};
+    printf("triangles,obj ms,indices ms,binary ms\n");
+    for (int size : sizes) {
+        if (!writeGrid(path, size)) {
+            fprintf(stderr, "Failed to write %s\n", path.c_str());
+            return -1;
+        }
+        
+        // Parse source
+        Mesh mesh;
+        auto start = std::chrono::steady_clock::now();
+        if (!mesh.load(path, &pool)) {
+            fprintf(stderr, "Failed to load %s\n", path.c_str());
+            return -1;
+        }
+        double obj = getMilliseconds(start);
+        
+        // Weld and reorder vertices
+        start = std::chrono::steady_clock::now();
+        mesh.buildIndices();
+        double indices = getMilliseconds(start);
+        
+        // Reload from cache
+        if (!mesh.saveBinary(cache)) {
+            fprintf(stderr, "Failed to write %s\n", cache.c_str());
+            return -1;
+        }
+        Mesh cached;
+        start = std::chrono::steady_clock::now();
+        if (!cached.loadBinary(cache)) {
+            fprintf(stderr, "Failed to load %s\n", cache.c_str());
+            return -1;
+        }
+        double binary = getMilliseconds(start);
+        printf("%d,%.2f,%.2f,%.2f\n", mesh.getCount() / 3, obj, indices, binary);
+    }
+    remove(path.c_str());
+    remove(cache.c_str());
+    return 0;
+}